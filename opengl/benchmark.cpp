@@ -0,0 +1,250 @@
+// throughput benchmark of Render on procedurally generated meshes.
+// separate executable, build it from this file and glad.c instead of kernel.cpp.
+//
+//   benchmark [--quick] [--software] [--out results.jsonl]
+//
+// every configuration appends one JSON object per line to the output file so runs can be compared over time.
+// computed_bytes_read_back_per_render is the size of the outputs read per frame worked out from the mode, not measured.
+// process_peak_rss_bytes is the high-water mark of the whole process since it started, so it only ever grows from one
+// configuration to the next. render_gpu_bytes is Render::getGpuMemoryBytes() of the Render used, an estimate.
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define _CRT_SECURE_NO_WARNINGS
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <Eigen/Dense>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#include "stb_image_write.h"
+#include "shader.h"
+#include "model.h"
+#include "camera.h"
+#include "render.h"
+#include "glcontext.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// of the whole process, every Render and model created so far included
+static long long peakRSSBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+    return (long long)pmc.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (long long)usage.ru_maxrss * 1024;
+#endif
+}
+
+// a sphere of radius 1000 cut into meshCount longitude bands, about `triangles` triangles in total.
+// deterministic, so every run renders exactly the same geometry.
+static Model* makeSphereModel(long long triangles, int meshCount) {
+    std::vector<Mesh> meshes;
+    long long perMesh = triangles / meshCount;
+    // every band is a grid of n x n quads, two triangles each
+    int n = (int)std::ceil(std::sqrt(perMesh / 2.0));
+    if (n < 1) n = 1;
+    const float radius = 1000;
+    for (int m = 0; m < meshCount; m++) {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        vertices.reserve((size_t)(n + 1) * (n + 1));
+        indices.reserve((size_t)n * n * 6);
+        float lon0 = 2 * (float)PI * m / meshCount;
+        float lon1 = 2 * (float)PI * (m + 1) / meshCount;
+        for (int i = 0; i <= n; i++) {
+            float lat = (float)PI * ((float)i / n - 0.5f);
+            for (int j = 0; j <= n; j++) {
+                float lon = lon0 + (lon1 - lon0) * j / n;
+                Vertex v;
+                v.Normal = V3f(std::cos(lat) * std::cos(lon), std::sin(lat), std::cos(lat) * std::sin(lon));
+                v.Position = radius * v.Normal;
+                v.TexCoords = Eigen::Vector2f((float)j / n, (float)i / n);
+                v.Tangent = V3f::Zero();
+                v.Bitangent = V3f::Zero();
+                vertices.push_back(v);
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                unsigned int a = i * (n + 1) + j, b = a + 1, c = a + n + 1, d = c + 1;
+                unsigned int quad[] = { a, c, b, b, c, d };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        aiColor4D color;
+        color.r = (m % 7) / 7.0f; color.g = (m % 5) / 5.0f; color.b = (m % 3) / 3.0f; color.a = 1;
+        meshes.push_back(Mesh(vertices, indices, std::vector<Texture>(), color));
+    }
+    return new Model(meshes);
+}
+
+struct BenchMode {
+    const char* name;
+    bool isRenderGrayImage;
+    bool isMSAAEnable;
+    bool isRenderBackGround;
+    bool isReadPos;
+};
+
+struct BenchScene {
+    long long triangles;
+    int meshes;
+};
+
+int main(int argc, char** argv) {
+    bool isQuick = false;
+    bool isSoftware = false;
+    std::string outPath = "bench_results.jsonl";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--quick")) isQuick = true;
+        else if (!strcmp(argv[i], "--software")) isSoftware = true;
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) outPath = argv[++i];
+        else {
+            printf("usage: %s [--quick] [--software] [--out results.jsonl]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    std::vector<std::pair<int, int>> resolutions = { {640, 480}, {1920, 1440}, {4096, 3072} };
+    std::vector<BenchScene> scenes = { {10000, 1}, {100000, 1}, {1000000, 1}, {10000000, 1}, {1000000, 10}, {1000000, 100}, {1000000, 1000}, {1000000, 4000} };
+    std::vector<BenchMode> modes = {
+        { "color", false, false, false, false },
+        { "gray", true, false, false, false },
+        { "color_msaa", false, true, false, false },
+        { "gray_background", true, false, true, false },
+        { "color_background", false, false, true, false },
+        { "gray_pos", true, false, false, true },
+    };
+    if (isQuick) {
+        resolutions = { {640, 480} };
+        scenes = { {10000, 1}, {100000, 100} };
+    }
+    const double minSeconds = isQuick ? 0.2 : 1.0;
+    const int minFrames = 5, maxFrames = 500, warmupFrames = 3;
+
+    GLFWwindow* window = createGLContext(resolutions[0].first, resolutions[0].second, true, isSoftware);
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    FILE* out = fopen(outPath.c_str(), "a");
+    if (!out) {
+        printf("can not open %s\n", outPath.c_str());
+        return -1;
+    }
+    long long runTime = (long long)time(NULL);
+
+    // background image, written once so the background pass has something to sample
+    const char* bgPath = "bench_background.png";
+    {
+        int w = 1024, h = 768;
+        std::vector<unsigned char> bg((size_t)w * h * 3);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++) {
+                unsigned char* p = &bg[((size_t)y * w + x) * 3];
+                p[0] = (unsigned char)(x * 255 / w); p[1] = (unsigned char)(y * 255 / h); p[2] = (unsigned char)(((x / 32 + y / 32) & 1) * 255);
+            }
+        stbi_write_png(bgPath, w, h, 3, bg.data(), w * 3);
+    }
+
+    // one Render per resolution, reused for every scene and mode
+    std::vector<std::unique_ptr<Camera>> cameras(resolutions.size());
+    std::vector<std::unique_ptr<Render>> renders(resolutions.size());
+    ModelTransformDesc td;
+    for (auto& scene : scenes) {
+        Model* model = makeSphereModel(scene.triangles, scene.meshes);
+        long long triangles = 0;
+        for (auto& mesh : model->meshes) triangles += mesh.indices.size() / 3;
+        for (size_t r = 0; r < resolutions.size(); r++) {
+            int width = resolutions[r].first, height = resolutions[r].second;
+            if (!renders[r]) {
+                // same field of view at every resolution, the sphere fills about half of the frame
+                CameraPara C;
+                C.width = (float)width; C.height = (float)height;
+                C.dx = 5e-6f * 1920 / C.width; C.dy = C.dx; C.f = 0.01f;
+                C.x0 = C.width / 2; C.y0 = C.height / 2;
+                cameras[r].reset(new Camera(C, V3f(0, 0, 3000)));
+                RenderDesc desc;
+                desc.camera = cameras[r].get();
+                desc.bodyModel = model;
+                desc.tranDesc = &td;
+                desc.bgImagePath = bgPath;
+                renders[r].reset(new Render(desc));
+            }
+            Render& render = *renders[r];
+            // draw() draws into the viewport set when the last Render was constructed, which may be another resolution
+            glViewport(0, 0, width, height);
+            render.setModels(model, NULL);
+            std::vector<unsigned char> pixels((size_t)width * height * 3);
+            std::vector<float> pos((size_t)width * height * 3);
+
+            for (auto& mode : modes) {
+                render.setGrayRenderStatus(mode.isRenderGrayImage);
+                render.setMSAAStatus(mode.isMSAAEnable);
+                render.setbgRenderStatus(mode.isRenderBackGround);
+                render.setPosRenderStatus(mode.isReadPos);
+                long long bytesPerFrame = (long long)width * height * (mode.isRenderGrayImage ? 1 : 3);
+                if (mode.isReadPos) bytesPerFrame += (long long)width * height * 3 * sizeof(float);
+
+                auto frame = [&]() {
+                    render.setMSAAStatus(mode.isMSAAEnable);
+                    render.draw();
+                    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                    if (mode.isRenderGrayImage) {
+                        glBindTexture(GL_TEXTURE_2D, render.getGrayTexture());
+                        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+                    }
+                    else {
+                        glBindTexture(GL_TEXTURE_2D, render.getScreenTexture());
+                        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+                    }
+                    if (mode.isReadPos) {
+                        glBindTexture(GL_TEXTURE_2D, render.getPosTexture());
+                        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, pos.data());
+                    }
+                    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+                };
+                for (int i = 0; i < warmupFrames; i++) frame();
+                glFinish();
+
+                int frames = 0;
+                auto start = std::chrono::steady_clock::now();
+                double seconds = 0;
+                while (frames < maxFrames && (frames < minFrames || seconds < minSeconds)) {
+                    frame();
+                    frames++;
+                    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+                double rendersPerSecond = frames / seconds;
+
+                printf("%9lld tris %5d meshes %4dx%-4d %-17s %9.2f renders/s\n", triangles, scene.meshes, width, height, mode.name, rendersPerSecond);
+                fprintf(out, "{\"time\": %lld, \"renderer\": \"%s\", \"software\": %s, \"triangles\": %lld, \"meshes\": %d, "
+                    "\"width\": %d, \"height\": %d, \"mode\": \"%s\", \"frames\": %d, \"seconds\": %.6f, \"renders_per_second\": %.3f, "
+                    "\"computed_bytes_read_back_per_render\": %lld, \"process_peak_rss_bytes\": %lld, \"render_gpu_bytes\": %zu}\n",
+                    runTime, renderer ? renderer : "", isSoftware ? "true" : "false", triangles, scene.meshes,
+                    width, height, mode.name, frames, seconds, rendersPerSecond, bytesPerFrame, peakRSSBytes(), render.getGpuMemoryBytes());
+                fflush(out);
+            }
+        }
+        model->release();
+        delete model;
+    }
+    fclose(out);
+    // the Renders free their GL objects, so they go before the programs and the context
+    renders.clear();
+    cameras.clear();
+    ProgramCache::instance().release();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
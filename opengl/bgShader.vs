@@ -4,8 +4,11 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// part of the background image covered by the frame: offset xy, size zw
+uniform vec4 bgRect;
+
 void main()
 {
-    TexCoords = aTexCoords;
+    TexCoords = bgRect.xy + aTexCoords * bgRect.zw;
     gl_Position = vec4(aPos.x, aPos.y, 0.9999, 1.0); 
 }  
\ No newline at end of file
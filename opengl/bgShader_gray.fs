@@ -6,9 +6,11 @@ uniform sampler2D bgTexture;
 
 layout (location = 0) out float FragColor;
 layout (location = 1) out vec3 Pos;
+layout (location = 2) out uvec2 Id;
 
 void main(){
     vec4 color = texture(bgTexture, TexCoords);
     FragColor = color.x*0.299 + color.y*0.587 + color.z*0.114;
     Pos = vec3(1e6, 1e6, 1e6);
+    Id = uvec2(0u);
 } 
\ No newline at end of file
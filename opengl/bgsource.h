@@ -0,0 +1,426 @@
+#ifndef BGSOURCE_H
+#define BGSOURCE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// raw streams easily exceed 2 GB, plain fseek/ftell take a long which is 32 bit on Windows
+#ifdef _WIN32
+#define bgFseek _fseeki64
+#define bgFtell _ftelli64
+#else
+#define bgFseek fseeko
+#define bgFtell ftello
+#endif
+
+// one decoded background frame, always tightly packed RGB rows, bottom row first (same as stbi with flip on load)
+struct BgFrame {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> data;
+};
+
+// a source of background frames. decode() is called from worker threads, possibly for several indices at the same time,
+// and must return false once the index is past the end of the stream.
+class BackgroundSource {
+public:
+    virtual ~BackgroundSource() {}
+    // number of frames, -1 if unknown (live stream)
+    virtual long frameCount() { return -1; }
+    virtual bool decode(long index, BgFrame& frame) = 0;
+    // for a source whose decode() can wait for data: cancel() makes decode() return false, also the calls waiting already,
+    // until resume(). a reader that stops uses them, the source stays with its owner and can be read again
+    virtual void cancel() {}
+    virtual void resume() {}
+};
+
+// every image file in a directory, in file name order
+class ImageSequenceSource : public BackgroundSource {
+public:
+    std::vector<std::string> files;
+
+    ImageSequenceSource(std::string const& directory) {
+        std::error_code ec;
+        for (auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            if (!entry.is_regular_file()) continue;
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga")
+                files.push_back(entry.path().string());
+        }
+        if (ec || files.empty())
+            printf("Image sequence directory %s contains no readable image\n", directory.c_str());
+        std::sort(files.begin(), files.end());
+    }
+
+    long frameCount() { return (long)files.size(); }
+
+    bool decode(long index, BgFrame& frame) {
+        if (index < 0 || index >= (long)files.size()) return false;
+        int nchannels;
+        unsigned char* data = stbi_load(files[index].c_str(), &frame.width, &frame.height, &nchannels, 3);
+        if (data == 0) {
+            printf("Background image %s is not properly loaded\n", files[index].c_str());
+            return false;
+        }
+        frame.data.assign(data, data + (size_t)frame.width * frame.height * 3);
+        stbi_image_free(data);
+        return true;
+    }
+};
+
+enum RawFormat {
+    RAW_RGB24,
+    RAW_GRAY8,
+    RAW_YUV420P,    // I420, full Y plane followed by quarter size U and V planes
+    RAW_NV12,       // full Y plane followed by interleaved UV plane
+    RAW_YUYV        // packed 4:2:2
+};
+
+// headerless file of fixed size frames, rows stored top to bottom as the cameras deliver them
+class RawStreamSource : public BackgroundSource {
+public:
+    RawStreamSource(std::string const& path, int width, int height, RawFormat format): width(width), height(height), format(format)
+    {
+        fp = fopen(path.c_str(), "rb");
+        if (!fp) {
+            printf("Raw background stream %s can not be opened\n", path.c_str());
+            return;
+        }
+        bgFseek(fp, 0, SEEK_END);
+        long long bytes = bgFtell(fp);
+        frames = (long)(bytes / frameBytes());
+    }
+
+    ~RawStreamSource() {
+        if (fp) fclose(fp);
+    }
+
+    long frameCount() { return frames; }
+
+    size_t frameBytes() {
+        size_t pixels = (size_t)width * height;
+        switch (format) {
+        case RAW_RGB24: return pixels * 3;
+        case RAW_GRAY8: return pixels;
+        case RAW_YUYV: return pixels * 2;
+        default: return pixels * 3 / 2;
+        }
+    }
+
+    bool decode(long index, BgFrame& frame) {
+        if (!fp || index < 0 || index >= frames) return false;
+        std::vector<unsigned char> raw(frameBytes());
+        {
+            // only the read itself is serialized, color conversion runs in parallel
+            std::lock_guard<std::mutex> lock(fileMutex);
+            bgFseek(fp, index * (long long)raw.size(), SEEK_SET);
+            if (fread(raw.data(), 1, raw.size(), fp) != raw.size()) return false;
+        }
+        frame.width = width;
+        frame.height = height;
+        frame.data.resize((size_t)width * height * 3);
+        for (int r = 0; r < height; r++) {
+            // flip vertically so that the frame matches what stbi_load gives with flip on load
+            unsigned char* dst = &frame.data[(size_t)(height - 1 - r) * width * 3];
+            for (int c = 0; c < width; c++) {
+                int y, u = 128, v = 128;
+                size_t p = (size_t)r * width + c;
+                switch (format) {
+                case RAW_RGB24:
+                    memcpy(dst + 3 * c, &raw[3 * p], 3);
+                    continue;
+                case RAW_GRAY8:
+                    dst[3 * c] = dst[3 * c + 1] = dst[3 * c + 2] = raw[p];
+                    continue;
+                case RAW_YUV420P: {
+                    size_t planeY = (size_t)width * height;
+                    size_t q = (size_t)(r / 2) * (width / 2) + c / 2;
+                    y = raw[p]; u = raw[planeY + q]; v = raw[planeY + planeY / 4 + q];
+                    break;
+                }
+                case RAW_NV12: {
+                    size_t q = (size_t)width * height + (size_t)(r / 2) * width + (c & ~1);
+                    y = raw[p]; u = raw[q]; v = raw[q + 1];
+                    break;
+                }
+                case RAW_YUYV: {
+                    size_t q = ((size_t)r * width + (c & ~1)) * 2;
+                    y = raw[2 * p]; u = raw[q + 1]; v = raw[q + 3];
+                    break;
+                }
+                }
+                yuvToRgb(y, u, v, dst + 3 * c);
+            }
+        }
+        return true;
+    }
+
+private:
+    FILE* fp = NULL;
+    int width;
+    int height;
+    RawFormat format;
+    long frames = 0;
+    std::mutex fileMutex;
+
+    // BT.601 limited range
+    static void yuvToRgb(int y, int u, int v, unsigned char* rgb) {
+        int c = y - 16, d = u - 128, e = v - 128;
+        int r = (298 * c + 409 * e + 128) >> 8;
+        int g = (298 * c - 100 * d - 208 * e + 128) >> 8;
+        int b = (298 * c + 516 * d + 128) >> 8;
+        rgb[0] = (unsigned char)std::min(255, std::max(0, r));
+        rgb[1] = (unsigned char)std::min(255, std::max(0, g));
+        rgb[2] = (unsigned char)std::min(255, std::max(0, b));
+    }
+};
+
+// frames pushed from memory by the application, e.g. straight from a camera grab callback.
+// push() blocks while the ring is full, close() marks the end of the stream.
+class RingBufferSource : public BackgroundSource {
+public:
+    RingBufferSource(int capacity = 8): capacity(capacity) {}
+
+    // rgb rows bottom row first when flipRows is false, top row first (camera order) when true
+    void push(const unsigned char* rgb, int width, int height, bool flipRows = true) {
+        BgFrame frame;
+        frame.width = width;
+        frame.height = height;
+        frame.data.resize((size_t)width * height * 3);
+        size_t rowBytes = (size_t)width * 3;
+        for (int r = 0; r < height; r++)
+            memcpy(&frame.data[(size_t)(flipRows ? height - 1 - r : r) * rowBytes], rgb + r * rowBytes, rowBytes);
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return (int)ring.size() < capacity; });
+        ring.push_back(std::move(frame));
+        cond.notify_all();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        cond.notify_all();
+    }
+
+    bool decode(long index, BgFrame& frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // frames come out strictly in push order, a worker asking for a later index waits for its turn
+        cond.wait(lock, [&] { return (first + index == popped && !ring.empty()) || closed || cancelled; });
+        if (cancelled || first + index != popped || ring.empty()) return false;
+        frame = std::move(ring.front());
+        ring.pop_front();
+        popped++;
+        cond.notify_all();
+        return true;
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+        cond.notify_all();
+    }
+
+    // the frames not read yet stay, the next reader gets them from its index 0
+    void resume() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = false;
+        first = popped;
+    }
+
+private:
+    int capacity;
+    std::deque<BgFrame> ring;
+    long popped = 0;
+    long first = 0;                 // frames read before the current reader started
+    bool closed = false;
+    bool cancelled = false;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+// decodes frames of a BackgroundSource ahead of time on worker threads.
+// at most `depth` frames are decoded but not yet consumed. the source is not owned and outlives the streamer.
+class BackgroundStreamer {
+public:
+    BackgroundStreamer(BackgroundSource* source, int depth = 4, int workers = 2): source(source), slots(depth)
+    {
+        for (int i = 0; i < workers; i++)
+            threads.emplace_back(&BackgroundStreamer::work, this);
+    }
+
+    ~BackgroundStreamer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            cond.notify_all();
+        }
+        // wakes the workers waiting in decode(). frames decoded ahead are dropped with the streamer, the rest stay in the source
+        source->cancel();
+        for (auto& t : threads) t.join();
+        source->resume();
+    }
+
+    // waits for the next frame in order, NULL at the end of the stream. call release() when done with it.
+    BgFrame* acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        Slot& slot = slots[consumed % slots.size()];
+        cond.wait(lock, [&] { return slot.index == consumed && (slot.state == SLOT_READY || slot.state == SLOT_END); });
+        if (slot.state == SLOT_END) return NULL;
+        return &slot.frame;
+    }
+
+    // the next frame when it is decoded already, never waits. NULL also at the end of the stream
+    BgFrame* tryAcquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Slot& slot = slots[consumed % slots.size()];
+        return slot.index == consumed && slot.state == SLOT_READY ? &slot.frame : NULL;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Slot& slot = slots[consumed % slots.size()];
+        if (slot.state == SLOT_END) return;
+        slot.state = SLOT_EMPTY;
+        consumed++;
+        cond.notify_all();
+    }
+
+private:
+    enum SlotState { SLOT_EMPTY, SLOT_DECODING, SLOT_READY, SLOT_END };
+    struct Slot {
+        long index = -1;
+        SlotState state = SLOT_EMPTY;
+        BgFrame frame;
+    };
+    BackgroundSource* source;
+    std::vector<Slot> slots;
+    std::vector<std::thread> threads;
+    long scheduled = 0;
+    long consumed = 0;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock, [&] { return stopping || (scheduled < consumed + (long)slots.size() && slots[scheduled % slots.size()].state == SLOT_EMPTY); });
+            if (stopping) return;
+            long index = scheduled++;
+            Slot& slot = slots[index % slots.size()];
+            slot.index = index;
+            slot.state = SLOT_DECODING;
+            lock.unlock();
+            bool ok = source->decode(index, slot.frame);
+            lock.lock();
+            slot.state = ok ? SLOT_READY : SLOT_END;
+            cond.notify_all();
+        }
+    }
+};
+
+// uploads frames through a ring of pixel buffer objects into two textures that are allocated once and reused.
+// stage() copies a frame into the next pixel buffer, commit() queues the transfer of the staged frame into the texture
+// not being sampled and swaps the two. staging frame N + 1 right after committing frame N lets the copy on the CPU
+// overlap the transfer and the draws of frame N, the ring keeps a buffer still read by the GPU from being rewritten.
+class BackgroundUploader {
+public:
+    static const int PBO_COUNT = 3;
+
+    BackgroundUploader() {
+        glGenBuffers(PBO_COUNT, pbo);
+        glGenTextures(2, textures);
+    }
+
+    ~BackgroundUploader() {
+        glDeleteBuffers(PBO_COUNT, pbo);
+        glDeleteTextures(2, textures);
+    }
+
+    // false when the pixel buffer can not be mapped, nothing is staged then
+    bool stage(const BgFrame& frame) {
+        size_t bytes = frame.data.size();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[pboIndex]);
+        // orphan the previous storage so the driver never waits for an upload still in flight
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (dst) {
+            memcpy(dst, frame.data.data(), bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            staged = pboIndex;
+            stagedWidth = frame.width;
+            stagedHeight = frame.height;
+            pboBytes[pboIndex] = bytes;
+            pboIndex = (pboIndex + 1) % PBO_COUNT;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return dst != NULL;
+    }
+
+    bool hasStaged() { return staged >= 0; }
+    // false until the first commit(), the textures have no storage before
+    bool hasFrame() { return width > 0; }
+    // drops the staged frame, e.g. when the source changes
+    void discard() { staged = -1; }
+
+    // false when nothing was staged
+    bool commit() {
+        if (staged < 0) return false;
+        if (stagedWidth != width || stagedHeight != height) {
+            // storage is only (re)allocated when the stream resolution changes
+            width = stagedWidth;
+            height = stagedHeight;
+            for (int i = 0; i < 2; i++) {
+                glBindTexture(GL_TEXTURE_2D, textures[i]);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[staged]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, textures[1 - front]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        front = 1 - front;
+        staged = -1;
+        return true;
+    }
+
+    unsigned int getTexture() { return textures[front]; }
+    // both textures as RGBA, which is how drivers store RGB8, and the frames in the pixel buffers
+    size_t getGpuMemoryBytes() {
+        size_t bytes = (size_t)width * height * 2 * 4;
+        for (size_t b : pboBytes) bytes += b;
+        return bytes;
+    }
+
+private:
+    unsigned int pbo[PBO_COUNT];
+    unsigned int textures[2];
+    size_t pboBytes[PBO_COUNT] = {};
+    int front = 0;
+    int pboIndex = 0;
+    int staged = -1;                // pbo holding a frame not committed yet
+    int stagedWidth = 0;
+    int stagedHeight = 0;
+    int width = 0;
+    int height = 0;
+};
+
+#endif
@@ -3,6 +3,8 @@
 # define PI 3.14159265358979323846
 #include <Eigen\Dense>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 typedef Eigen::Vector3f V3f;
 typedef Eigen::Matrix4f M4f;
 
@@ -16,6 +18,12 @@ struct CameraPara {
     float y0;
     float zNear = 100;
     float zFar = 10000;
+    // Brown-Conrady distortion in OpenCV order and convention (y axis pointing down the image)
+    float k1 = 0;
+    float k2 = 0;
+    float p1 = 0;
+    float p2 = 0;
+    float k3 = 0;
 };
 
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
@@ -39,13 +47,7 @@ public:
 
     // construct Camera from a viewmat
     Camera(M4f aviewMat) {
-        viewMat = aviewMat;
-        Right = viewMat.block(0, 0, 1, 3).transpose();
-        Up = viewMat.block(1, 0, 1, 3).transpose();
-        Front = -viewMat.block(2, 0, 1, 3).transpose();
-        Eigen::Matrix3f A = viewMat.block(0, 0, 3, 3);
-        A.block(0, 0, 2, 3) = -A.block(0, 0, 2, 3);
-        Position = A.ldlt().solve(viewMat.block(0, 3, 3, 1));
+        setViewMatrix(aviewMat);
     }
 
     // only use in oneStepRender
@@ -55,14 +57,24 @@ public:
     }
 
     // returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    M4f getViewMatrix(){
+    const M4f& getViewMatrix() const {
         return viewMat;
     }
 
-    M4f getPerspectiveMatrix() {
+    const M4f& getPerspectiveMatrix() const {
         return perspectiveMat;
     }
 
+    // the view matrix is a rigid transform, so the position is simply -R^T * t
+    void setViewMatrix(const M4f& aviewMat) {
+        viewMat = aviewMat;
+        Eigen::Matrix3f R = viewMat.block<3, 3>(0, 0);
+        Right = R.row(0).transpose();
+        Up = R.row(1).transpose();
+        Front = -R.row(2).transpose();
+        Position = -R.transpose() * viewMat.block<3, 1>(0, 3);
+    }
+
     V3f getPosition() {
         return Position;
     }
@@ -89,10 +101,91 @@ public:
 
     void setCameraPara(CameraPara CC) {
         C = CC;
+        intrinsicVersion++;
         calculatePerspectiveMat();
     }
 
+    CameraPara getCameraPara() {
+        return C;
+    }
+
+    // intrinsics of the w x h window of this camera's image starting at pixel (x, y), bottom-left origin like y0.
+    // only the principal point moves, so the window sees exactly the matching sub-frustum.
+    CameraPara getSubPara(int x, int y, int w, int h) {
+        CameraPara sub = C;
+        sub.width = (float)w;
+        sub.height = (float)h;
+        sub.x0 = C.x0 - x;
+        sub.y0 = C.y0 - y;
+        return sub;
+    }
+
+    M4f getSubPerspectiveMatrix(int x, int y, int w, int h) {
+        return calculatePerspective(getSubPara(x, y, w, h));
+    }
+
+    // increases every time the intrinsics change, so that anything derived from them knows when to rebuild
+    int getIntrinsicVersion() {
+        return intrinsicVersion;
+    }
+
+    bool hasDistortion() {
+        return C.k1 != 0 || C.k2 != 0 || C.p1 != 0 || C.p2 != 0 || C.k3 != 0;
+    }
+
+    // for every pixel of the real (distorted) image, the texture coordinate in the pinhole image rendered with
+    // perspectiveMat where that pixel has to be sampled. map holds width*height (s, t) pairs, bottom row first like GL textures.
+    void calculateDistortionMap(std::vector<float>& map) {
+        int w = (int)C.width, h = (int)C.height;
+        map.resize((size_t)w * h * 2);
+        for (int v = 0; v < h; v++) {
+            for (int u = 0; u < w; u++) {
+                double x, y;
+                undistortPixel(u + 0.5, v + 0.5, x, y);
+                size_t i = ((size_t)v * w + u) * 2;
+                map[i] = (float)(x / w);
+                map[i + 1] = (float)(y / h);
+            }
+        }
+    }
+
+    // largest distance in pixels between a pixel of the real image and where it is sampled in the pinhole image, over
+    // the border of the image and a grid of `step` pixels inside it
+    float getMaxDistortionShift(int step = 16) {
+        int w = (int)C.width, h = (int)C.height;
+        double shift = 0;
+        auto measure = [&](int u, int v) {
+            double x, y;
+            undistortPixel(u + 0.5, v + 0.5, x, y);
+            shift = std::max(shift, std::hypot(x - (u + 0.5), y - (v + 0.5)));
+        };
+        for (int v = 0; v < h; v += step)
+            for (int u = 0; u < w; u += step) measure(u, v);
+        for (int u = 0; u < w; u++) { measure(u, 0); measure(u, h - 1); }
+        for (int v = 0; v < h; v++) { measure(0, v); measure(w - 1, v); }
+        return (float)shift;
+    }
+
 private:
+    // position (u, v) of the real image in the pinhole image, both in pixels with a bottom-left origin
+    void undistortPixel(double u, double v, double& px, double& py) {
+        // normalized distorted coordinates, y flipped to the OpenCV convention the coefficients come from
+        double xd = (u - C.x0) * C.dx / C.f;
+        double yd = (C.y0 - v) * C.dy / C.f;
+        // invert the distortion by fixed point iteration, same as cv::undistortPoints
+        double x = xd, y = yd;
+        for (int i = 0; i < 10; i++) {
+            double r2 = x * x + y * y;
+            double icdist = 1 / (1 + ((C.k3 * r2 + C.k2) * r2 + C.k1) * r2);
+            double deltaX = 2 * C.p1 * x * y + C.p2 * (r2 + 2 * x * x);
+            double deltaY = C.p1 * (r2 + 2 * y * y) + 2 * C.p2 * x * y;
+            x = (xd - deltaX) * icdist;
+            y = (yd - deltaY) * icdist;
+        }
+        px = x * C.f / C.dx + C.x0;
+        py = C.y0 - y * C.f / C.dy;
+    }
+
     V3f Position;
     V3f Front = V3f(0.0f, 0.0f, -1.0f);
     V3f Up;
@@ -101,6 +194,7 @@ private:
     float Yaw;
     float Pitch;
     CameraPara C;
+    int intrinsicVersion = 0;
     M4f viewMat;
     M4f perspectiveMat;
 
@@ -137,7 +231,11 @@ private:
     }
 
     void calculatePerspectiveMat() {
-        perspectiveMat = M4f::Zero();
+        perspectiveMat = calculatePerspective(C);
+    }
+
+    static M4f calculatePerspective(const CameraPara& C) {
+        M4f perspectiveMat = M4f::Zero();
         float r = (C.width - C.x0) * C.dx;
         float l = -C.x0 * C.dx;
         float t = (C.height - C.y0) * C.dy;
@@ -149,6 +247,7 @@ private:
         perspectiveMat(2, 2) = (C.zNear + C.zFar) / (C.zNear - C.zFar);
         perspectiveMat(2, 3) = 2 * C.zFar * C.zNear / (C.zNear - C.zFar);
         perspectiveMat(3, 2) = -1;
+        return perspectiveMat;
     }
 };
 
@@ -0,0 +1,10 @@
+#version 330 core
+
+flat in vec2 Value;
+
+layout (location = 0) out vec2 Sum;
+
+void main()
+{
+    Sum = Value;
+}
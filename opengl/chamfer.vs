@@ -0,0 +1,28 @@
+#version 330 core
+// edge point in output pixels, bottom-left origin
+layout (location = 0) in vec2 aPoint;
+
+// distance capped at truncation and 1, or nothing for points outside of the output
+flat out vec2 Value;
+
+uniform sampler2D distanceTexture;
+// size of the distance texture and of the part of it in use
+uniform vec2 fieldSize;
+uniform vec2 size;
+uniform float truncation;
+
+// every point lands on the single pixel of the target, where additive blending sums them up
+void main()
+{
+    if (any(lessThan(aPoint, vec2(0.0))) || any(greaterThanEqual(aPoint, size))) {
+        Value = vec2(0.0);
+    }
+    else {
+        // pixel centres of the field are at .5, the bilinear lookup gives sub-pixel distances. clamped so that the texels
+        // beyond the part in use are never blended in
+        vec2 uv = clamp(aPoint, vec2(0.5), size - 0.5) / fieldSize;
+        float d = textureLod(distanceTexture, uv, 0.0).x;
+        Value = vec2(min(d, truncation), 1.0);
+    }
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+}
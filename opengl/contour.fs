@@ -0,0 +1,49 @@
+#version 330 core
+
+// model space positions, 1e6 where nothing was drawn
+uniform sampler2D posTexture;
+uniform ivec2 size;
+// a step in position larger than this between neighbouring pixels is an occluding edge
+uniform float jumpThreshold;
+// cosine of the sharpest bend along a row or column that is not a crease, above 1 turns creases off
+uniform float creaseCos;
+
+// the pixel itself on edge pixels, -1 elsewhere. edges are marked on the covered side
+layout (location = 0) out vec2 Seed;
+
+vec3 fetch(ivec2 p)
+{
+    return texelFetch(posTexture, clamp(p, ivec2(0), size - 1), 0).xyz;
+}
+
+bool isCovered(vec3 p)
+{
+    return p.x < 1e5;
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec3 c = fetch(p);
+    Seed = vec2(-1.0);
+    if (!isCovered(c)) return;
+    for (int i = 0; i < 2; i++) {
+        ivec2 dir = i == 0 ? ivec2(1, 0) : ivec2(0, 1);
+        vec3 a = fetch(p - dir);
+        vec3 b = fetch(p + dir);
+        // silhouette and occlusion
+        if (!isCovered(a) || !isCovered(b) || distance(a, c) > jumpThreshold || distance(b, c) > jumpThreshold) {
+            Seed = vec2(p);
+            return;
+        }
+        // crease: the surface bends between the two steps. the frame border repeats c, which is never a crease
+        vec3 u = c - a;
+        vec3 v = b - c;
+        float lu = length(u);
+        float lv = length(v);
+        if (lu > 0.0 && lv > 0.0 && dot(u, v) < creaseCos * lu * lv) {
+            Seed = vec2(p);
+            return;
+        }
+    }
+}
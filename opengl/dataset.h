@@ -0,0 +1,442 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include "render.h"
+#include "readbackpool.h"
+#include "lz4block.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// renders stored as records in a few large files instead of one image file each:
+//   <path>.index        a 256 byte header, then one DatasetIndexEntry of 256 bytes per record, in record order
+//   <path>.NNN.data     chunks of records, each chunk starting at a multiple of 4096 bytes of its file
+// a chunk holds whole records, each record at a multiple of 4096 of the chunk and each of its outputs at a multiple of 64.
+// chunks are stored as they are or as one LZ4 block (lz4block.h), whichever is smaller when compression is on, so an
+// uncompressed data file can be memory mapped and its outputs used in place. files are only ever appended to, and the
+// entry of record id is at a fixed place of the index, so finding a record takes one read whatever the size of the set.
+// little endian only, the files are the in-memory layout.
+
+enum DatasetOutput {
+    DATASET_GRAY = 0,           // width x height bytes
+    DATASET_COLOR = 1,          // width x height x 3 bytes, RGB
+    DATASET_POS = 2,            // width x height x 3 floats, 1e6 where nothing was drawn
+    DATASET_MASK = 3,           // width x height bytes, 255 where a model was drawn
+    DATASET_OUTPUTS = 4
+};
+
+// what one render contributes, NULL outputs are not stored. rows bottom-up like the outputs of Render
+struct DatasetRecord {
+    int width = 0;
+    int height = 0;
+    const void* outputs[DATASET_OUTPUTS] = { NULL, NULL, NULL, NULL };
+    ModelTransformDesc pose;
+    float G = 0;
+    CameraPara camera = CameraPara();
+    M4f view = M4f::Identity();
+    RenderROI roi;              // where in the camera's frame the outputs lie, empty for the full frame
+};
+
+struct DatasetIndexEntry {
+    unsigned long long chunkOffset;     // of the chunk in its data file
+    unsigned int file;                  // NNN of the data file
+    unsigned int chunkBytes;            // stored size of the chunk
+    unsigned int chunkRawBytes;         // size of the chunk uncompressed
+    unsigned int codec;                 // 0 stored, 1 LZ4 block
+    unsigned int recordOffset;          // in the uncompressed chunk
+    unsigned int recordBytes;
+    int width;
+    int height;
+    unsigned int outputOffsets[DATASET_OUTPUTS];    // from the start of the record
+    unsigned int outputBytes[DATASET_OUTPUTS];      // 0 when not stored
+    float pose[7];                      // tx, ty, tz, rx, ry, rz, scale
+    float G;
+    float camera[14];                   // CameraPara in declaration order
+    float view[16];                     // column major like M4f
+    int roi[4];                         // x, y, width, height
+    unsigned int reserved[4];
+};
+static_assert(sizeof(DatasetIndexEntry) == 256, "the index entries are 256 bytes on disk");
+
+struct DatasetWriterDesc {
+    // a chunk is closed once its records take this much, records are never split across chunks. below 4 GiB, offsets in a
+    // chunk are 32 bit
+    size_t chunkBytes = (size_t)64 << 20;
+    // a new data file is started when the next chunk would make the current one larger than this
+    unsigned long long maxFileBytes = 4ull << 30;
+    bool isCompressed = false;
+};
+
+// 64 bit file positions, long is 32 bit on Windows
+inline bool datasetSeek(FILE* fp, unsigned long long offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, (long long)offset, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// appends records sequentially, see the top of this file for the layout
+class DatasetWriter {
+public:
+    static const unsigned int ALIGNMENT = 4096;
+    static const unsigned int OUTPUT_ALIGNMENT = 64;
+
+    ~DatasetWriter() { close(); }
+
+    bool open(std::string const& path, DatasetWriterDesc d = DatasetWriterDesc()) {
+        close();
+        if ((unsigned long long)d.chunkBytes >= (4ull << 30)) {
+            printf("a dataset chunk must be smaller than 4 GiB, not %zu bytes\n", d.chunkBytes);
+            return false;
+        }
+        this->path = path;
+        desc = d;
+        index = fopen((path + ".index").c_str(), "wb");
+        if (!index) {
+            printf("can not open %s.index for writing\n", path.c_str());
+            return false;
+        }
+        unsigned char header[sizeof(DatasetIndexEntry)] = {};
+        unsigned int fields[3] = { 1, (unsigned int)sizeof(DatasetIndexEntry), ALIGNMENT };
+        memcpy(header, "RMDI", 4);
+        memcpy(header + 4, fields, sizeof(fields));
+        fwrite(header, 1, sizeof(header), index);
+        fileNumber = 0;
+        fileOffset = 0;
+        records = 0;
+        return openData();
+    }
+
+    // returns the id of the record, -1 on failure
+    long long append(const DatasetRecord& r) {
+        if (!index) return -1;
+        DatasetIndexEntry e;
+        memset(&e, 0, sizeof(e));
+        e.width = r.width;
+        e.height = r.height;
+        size_t pixels = (size_t)r.width * r.height;
+        const size_t outputSizes[DATASET_OUTPUTS] = { pixels, pixels * 3, pixels * 3 * sizeof(float), pixels };
+        size_t recordBytes = 0;
+        for (int k = 0; k < DATASET_OUTPUTS; k++) {
+            if (!r.outputs[k]) continue;
+            e.outputOffsets[k] = (unsigned int)recordBytes;
+            e.outputBytes[k] = (unsigned int)outputSizes[k];
+            recordBytes = align(recordBytes + outputSizes[k], OUTPUT_ALIGNMENT);
+        }
+        if (recordBytes > 0xffffffffull - ALIGNMENT) {
+            printf("a record of %zu bytes is too large for the dataset\n", recordBytes);
+            return -1;
+        }
+        e.recordBytes = (unsigned int)recordBytes;
+        const float pose[7] = { r.pose.tx, r.pose.ty, r.pose.tz, r.pose.rx, r.pose.ry, r.pose.rz, r.pose.scale };
+        memcpy(e.pose, pose, sizeof(pose));
+        e.G = r.G;
+        const CameraPara& C = r.camera;
+        const float camera[14] = { C.width, C.height, C.f, C.dx, C.dy, C.x0, C.y0, C.zNear, C.zFar, C.k1, C.k2, C.p1, C.p2, C.k3 };
+        memcpy(e.camera, camera, sizeof(camera));
+        memcpy(e.view, r.view.data(), sizeof(e.view));
+        e.roi[0] = r.roi.x;
+        e.roi[1] = r.roi.y;
+        e.roi[2] = r.roi.width > 0 ? r.roi.width : r.width;
+        e.roi[3] = r.roi.height > 0 ? r.roi.height : r.height;
+
+        size_t start = align(chunk.size(), ALIGNMENT);
+        if (start > 0 && start + recordBytes > desc.chunkBytes) {
+            if (!flushChunk()) return -1;
+            start = 0;
+        }
+        chunk.resize(start + recordBytes, 0);
+        for (int k = 0; k < DATASET_OUTPUTS; k++)
+            if (r.outputs[k]) memcpy(&chunk[start + e.outputOffsets[k]], r.outputs[k], e.outputBytes[k]);
+        e.recordOffset = (unsigned int)start;
+        pending.push_back(e);
+        return records++;
+    }
+
+    // the outputs of the last draw of render at pose (the Render only keeps its model matrix), the flags (1 << DatasetOutput)
+    // choose which. gray is converted from color when the Render draws color, color can not be had from a Render in gray mode.
+    // -1 and nothing is added when an output can not be read back. pos and mask turn the pos output of the Render on
+    long long append(Render& render, const ModelTransformDesc& pose, unsigned int outputs) {
+        RenderROI roi = render.getROI();
+        size_t pixels = (size_t)roi.width * roi.height;
+        bool isGrayRender = render.getImageChannels() == 1;
+        if ((outputs & (1u << DATASET_COLOR)) && isGrayRender) {
+            printf("the Render draws gray, no color output for the dataset\n");
+            outputs &= ~(1u << DATASET_COLOR);
+        }
+        DatasetRecord r;
+        r.width = roi.width;
+        r.height = roi.height;
+        r.roi = roi;
+        if (outputs & ((1u << DATASET_GRAY) | (1u << DATASET_COLOR))) {
+            image.resize(pixels * render.getImageChannels());
+            if (!render.readImage(image.data())) return -1;
+            if (outputs & (1u << DATASET_COLOR)) r.outputs[DATASET_COLOR] = image.data();
+            if (outputs & (1u << DATASET_GRAY)) {
+                if (isGrayRender) r.outputs[DATASET_GRAY] = image.data();
+                else {
+                    // the weights of objectShader_gray.fs
+                    gray.resize(pixels);
+                    for (size_t i = 0; i < pixels; i++)
+                        gray[i] = (unsigned char)(image[i * 3] * 0.299f + image[i * 3 + 1] * 0.587f + image[i * 3 + 2] * 0.114f + 0.5f);
+                    r.outputs[DATASET_GRAY] = gray.data();
+                }
+            }
+        }
+        if (outputs & ((1u << DATASET_POS) | (1u << DATASET_MASK))) {
+            pos.resize(pixels * 3);
+            if (!render.readPos(pos.data())) return -1;
+            if (outputs & (1u << DATASET_POS)) r.outputs[DATASET_POS] = pos.data();
+            if (outputs & (1u << DATASET_MASK)) {
+                mask.resize(pixels);
+                for (size_t i = 0; i < pixels; i++) mask[i] = pos[i * 3] < 1e5f ? 255 : 0;
+                r.outputs[DATASET_MASK] = mask.data();
+            }
+        }
+        r.pose = pose;
+        r.G = render.getWingG();
+        r.camera = render.getCamera()->getCameraPara();
+        r.view = render.getCamera()->getViewMatrix();
+        return append(r);
+    }
+
+    long long size() { return records; }
+
+    bool close() {
+        if (!index) return true;
+        bool ok = flushChunk();
+        ok = fclose(index) == 0 && ok;
+        index = NULL;
+        if (data) ok = fclose(data) == 0 && ok;
+        data = NULL;
+        return ok;
+    }
+
+private:
+    std::string path;
+    DatasetWriterDesc desc;
+    FILE* index = NULL;
+    FILE* data = NULL;
+    unsigned int fileNumber = 0;
+    unsigned long long fileOffset = 0;
+    long long records = 0;
+    std::vector<unsigned char> chunk;               // records of the open chunk
+    std::vector<DatasetIndexEntry> pending;         // their entries, written once the chunk's place is known
+    std::vector<unsigned char> compressed;
+    std::vector<unsigned char> image, gray, mask;
+    std::vector<float> pos;
+
+    static size_t align(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+    bool openData() {
+        char name[16];
+        snprintf(name, sizeof(name), ".%03u.data", fileNumber);
+        data = fopen((path + name).c_str(), "wb");
+        if (!data) printf("can not open %s%s for writing\n", path.c_str(), name);
+        return data != NULL;
+    }
+
+    bool flushChunk() {
+        if (pending.empty()) return true;
+        if (!data) return false;
+        const unsigned char* stored = chunk.data();
+        size_t storedBytes = chunk.size();
+        unsigned int codec = 0;
+        if (desc.isCompressed) {
+            compressed.resize(lz4Bound(chunk.size()));
+            size_t n = lz4Compress(chunk.data(), chunk.size(), compressed.data());
+            if (n < chunk.size()) {
+                stored = compressed.data();
+                storedBytes = n;
+                codec = 1;
+            }
+        }
+        size_t paddedBytes = align(storedBytes, ALIGNMENT);
+        if (fileOffset > 0 && fileOffset + paddedBytes > desc.maxFileBytes) {
+            bool ok = fclose(data) == 0;
+            data = NULL;
+            fileNumber++;
+            fileOffset = 0;
+            if (!ok || !openData()) return false;
+        }
+        static const unsigned char zero[ALIGNMENT] = {};
+        bool ok = fwrite(stored, 1, storedBytes, data) == storedBytes
+            && fwrite(zero, 1, paddedBytes - storedBytes, data) == paddedBytes - storedBytes;
+        for (DatasetIndexEntry& e : pending) {
+            e.chunkOffset = fileOffset;
+            e.file = fileNumber;
+            e.chunkBytes = (unsigned int)storedBytes;
+            e.chunkRawBytes = (unsigned int)chunk.size();
+            e.codec = codec;
+        }
+        // the data reaches the file before the entries pointing at it, so an index left behind by a process that died
+        // never refers to records that are not there
+        ok = fflush(data) == 0 && ok;
+        ok = ok && fwrite(pending.data(), sizeof(DatasetIndexEntry), pending.size(), index) == pending.size();
+        ok = fflush(index) == 0 && ok;
+        if (!ok) printf("can not write to the dataset %s\n", path.c_str());
+        fileOffset += paddedBytes;
+        pending.clear();
+        chunk.clear();
+        return ok;
+    }
+};
+
+// the outputs of one record, NULL where not stored. they point into the reader and stay valid until its next read()
+struct DatasetRecordView {
+    DatasetIndexEntry entry;
+    const unsigned char* gray = NULL;
+    const unsigned char* color = NULL;
+    const float* pos = NULL;
+    const unsigned char* mask = NULL;
+};
+
+class DatasetReader {
+public:
+    ~DatasetReader() { close(); }
+
+    bool open(std::string const& path) {
+        close();
+        this->path = path;
+        index = fopen((path + ".index").c_str(), "rb");
+        if (!index) {
+            printf("can not open %s.index\n", path.c_str());
+            return false;
+        }
+        char magic[4];
+        unsigned int fields[3];
+        if (fread(magic, 1, 4, index) != 4 || memcmp(magic, "RMDI", 4) || fread(fields, 4, 3, index) != 3
+            || fields[0] != 1 || fields[1] != sizeof(DatasetIndexEntry)) {
+            printf("%s.index is not a dataset index\n", path.c_str());
+            close();
+            return false;
+        }
+        // the count follows from the file size, so the index of a writer that did not get to close() can still be read:
+        // it has the records of every chunk flushed before the process died, the open chunk is lost and a torn last entry
+        // is not counted. the files are fflush()ed, not synced, so this does not hold across a power loss
+#ifdef _WIN32
+        _fseeki64(index, 0, SEEK_END);
+        long long bytes = _ftelli64(index);
+#else
+        fseeko(index, 0, SEEK_END);
+        long long bytes = (long long)ftello(index);
+#endif
+        records = bytes / (long long)sizeof(DatasetIndexEntry) - 1;
+        return true;
+    }
+
+    long long size() { return records; }
+
+    bool getEntry(long long id, DatasetIndexEntry& e) {
+        if (!index || id < 0 || id >= records) return false;
+        return datasetSeek(index, (unsigned long long)(id + 1) * sizeof(DatasetIndexEntry))
+            && fread(&e, sizeof(e), 1, index) == 1;
+    }
+
+    bool read(long long id, DatasetRecordView& r) {
+        if (!getEntry(id, r.entry)) return false;
+        const DatasetIndexEntry& e = r.entry;
+        if (!isEntryValid(e)) {
+            printf("entry %lld of %s.index is damaged\n", id, path.c_str());
+            return false;
+        }
+        const unsigned char* record;
+        if (e.codec == 0) {
+            // only the record is read from a stored chunk
+            if (!reserve(buffer, bufferBytes, e.recordBytes) || !readData(e.file, e.chunkOffset + e.recordOffset, buffer, e.recordBytes))
+                return false;
+            cachedFile = -1;
+            record = buffer;
+        }
+        else {
+            // a compressed chunk is decoded whole and kept for the next record of the same chunk
+            if (cachedFile != (long long)e.file || cachedOffset != e.chunkOffset) {
+                cachedFile = -1;
+                if (!reserve(buffer, bufferBytes, e.chunkRawBytes) || !reserve(packed, packedBytes, e.chunkBytes)
+                    || !readData(e.file, e.chunkOffset, packed, e.chunkBytes)
+                    || lz4Decompress(packed, e.chunkBytes, buffer, e.chunkRawBytes) != (long long)e.chunkRawBytes) {
+                    printf("chunk at %llu of data file %u is damaged\n", e.chunkOffset, e.file);
+                    return false;
+                }
+                cachedFile = e.file;
+                cachedOffset = e.chunkOffset;
+            }
+            record = buffer + e.recordOffset;
+        }
+        const void* outputs[DATASET_OUTPUTS];
+        for (int k = 0; k < DATASET_OUTPUTS; k++) outputs[k] = e.outputBytes[k] ? record + e.outputOffsets[k] : NULL;
+        r.gray = (const unsigned char*)outputs[DATASET_GRAY];
+        r.color = (const unsigned char*)outputs[DATASET_COLOR];
+        r.pos = (const float*)outputs[DATASET_POS];
+        r.mask = (const unsigned char*)outputs[DATASET_MASK];
+        return true;
+    }
+
+    void close() {
+        if (index) fclose(index);
+        index = NULL;
+        if (data) fclose(data);
+        data = NULL;
+        dataNumber = -1;
+        cachedFile = -1;
+        alignedFree(buffer);
+        alignedFree(packed);
+        buffer = packed = NULL;
+        bufferBytes = packedBytes = 0;
+    }
+
+private:
+    std::string path;
+    FILE* index = NULL;
+    FILE* data = NULL;
+    long long dataNumber = -1;          // which data file is open
+    long long records = 0;
+    unsigned char* buffer = NULL;       // the record, or the decoded chunk, 64 byte aligned like the outputs on disk
+    size_t bufferBytes = 0;
+    unsigned char* packed = NULL;
+    size_t packedBytes = 0;
+    long long cachedFile = -1;          // the chunk decoded into buffer
+    unsigned long long cachedOffset = 0;
+
+    // the sizes the writer gives every output, and everything inside the record and the record inside its chunk, so
+    // that a torn or damaged entry can not point outside of what is read for it
+    static bool isEntryValid(const DatasetIndexEntry& e) {
+        if (e.codec > 1 || e.width < 0 || e.height < 0) return false;
+        if ((unsigned long long)e.recordOffset + e.recordBytes > e.chunkRawBytes) return false;
+        unsigned long long pixels = (unsigned long long)e.width * e.height;
+        const unsigned long long outputSizes[DATASET_OUTPUTS] = { pixels, pixels * 3, pixels * 3 * sizeof(float), pixels };
+        for (int k = 0; k < DATASET_OUTPUTS; k++) {
+            if (!e.outputBytes[k]) continue;
+            if (e.outputBytes[k] != outputSizes[k] || (unsigned long long)e.outputOffsets[k] + e.outputBytes[k] > e.recordBytes)
+                return false;
+        }
+        return true;
+    }
+
+    static bool reserve(unsigned char*& p, size_t& capacity, size_t bytes) {
+        if (bytes <= capacity) return true;
+        alignedFree(p);
+        p = (unsigned char*)alignedAlloc(bytes);
+        capacity = p ? bytes : 0;
+        return p != NULL;
+    }
+
+    bool readData(unsigned int file, unsigned long long offset, unsigned char* dst, size_t bytes) {
+        if (dataNumber != (long long)file) {
+            if (data) fclose(data);
+            char name[16];
+            snprintf(name, sizeof(name), ".%03u.data", file);
+            data = fopen((path + name).c_str(), "rb");
+            dataNumber = data ? file : -1;
+            if (!data) {
+                printf("can not open %s%s\n", path.c_str(), name);
+                return false;
+            }
+        }
+        return datasetSeek(data, offset) && fread(dst, 1, bytes, data) == bytes;
+    }
+};
+
+#endif
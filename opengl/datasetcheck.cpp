@@ -0,0 +1,254 @@
+// checks lz4block.h and the dataset files of dataset.h without a GL context.
+// separate executable, build it from this file and glad.c instead of kernel.cpp (dataset.h pulls in render.h).
+//
+//   datasetcheck [--path datasetcheck]
+//
+// the LZ4 codec round trips blocks of every kind (empty, tiny, incompressible, long runs, long literals and matches),
+// must reject or stay inside its output for truncated and corrupted blocks, and when liblz4 can be loaded at runtime
+// (POSIX only, no header needed) its blocks must decode here and the blocks written here must decode with it. then a
+// dataset is written stored and compressed, read back record by record, and the reader has to refuse a torn last
+// entry and entries whose offsets point outside their chunk or record. returns 0 when every check passes.
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define _CRT_SECURE_NO_WARNINGS
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <Eigen/Dense>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "stb_image_write.h"
+#include "dataset.h"
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    printf("FAILED: %s\n", what);
+    failures++;
+}
+
+static unsigned int rng = 12345;
+static unsigned int next() { rng = rng * 1664525u + 1013904223u; return rng >> 8; }
+
+// blocks of every kind the compressor has a separate path for
+static std::vector<std::vector<unsigned char>> makeBlocks() {
+    std::vector<std::vector<unsigned char>> blocks;
+    for (size_t n = 0; n <= 20; n++) {
+        std::vector<unsigned char> b(n);
+        for (auto& v : b) v = (unsigned char)(next() % 3);
+        blocks.push_back(b);
+    }
+    std::vector<unsigned char> noise(100000), zeros(100000, 0), mixed(300000), text;
+    for (auto& v : noise) v = (unsigned char)next();
+    // runs and copies mixed with literal stretches longer than 270 bytes, matches at offsets up to 65535
+    for (size_t i = 0; i < mixed.size(); i++) {
+        size_t region = (i / 4000) % 4;
+        if (region == 0) mixed[i] = (unsigned char)next();
+        else if (region == 1) mixed[i] = 7;
+        else if (region == 2 && i >= 65535) mixed[i] = mixed[i - 65535];
+        else mixed[i] = (unsigned char)(i % 251);
+    }
+    const char* words[] = { "wing ", "body ", "render ", "pose ", "chunk " };
+    while (text.size() < 50000) {
+        const char* w = words[next() % 5];
+        text.insert(text.end(), w, w + strlen(w));
+    }
+    blocks.push_back(noise);
+    blocks.push_back(zeros);
+    blocks.push_back(mixed);
+    blocks.push_back(text);
+    return blocks;
+}
+
+static void checkCodec() {
+    std::vector<std::vector<unsigned char>> blocks = makeBlocks();
+    int roundTrips = 0;
+    for (auto& b : blocks) {
+        std::vector<unsigned char> packed(lz4Bound(b.size())), unpacked(b.size() + 1);
+        size_t n = lz4Compress(b.data(), b.size(), packed.data());
+        long long m = lz4Decompress(packed.data(), n, unpacked.data(), b.size());
+        bool ok = n <= lz4Bound(b.size()) && m == (long long)b.size() && !memcmp(unpacked.data(), b.data(), b.size());
+        check(ok, "lz4 round trip");
+        roundTrips += ok;
+        // a damaged block may decode to anything, but never past the capacity it is given
+        if (n < 2) continue;
+        for (int k = 0; k < 50; k++) {
+            std::vector<unsigned char> bad(packed.begin(), packed.begin() + n);
+            if (k % 2) bad.resize(next() % n);
+            else bad[next() % n] ^= (unsigned char)(1 + next() % 255);
+            std::vector<unsigned char> guard(b.size() + 64, 0xa5);
+            long long r = lz4Decompress(bad.data(), bad.size(), guard.data(), b.size());
+            bool inside = r <= (long long)b.size();
+            for (size_t i = b.size(); i < guard.size(); i++) inside = inside && guard[i] == 0xa5;
+            check(inside, "lz4 damaged block stays inside its output");
+        }
+    }
+    printf("lz4: %d of %d blocks round trip\n", roundTrips, (int)blocks.size());
+
+#ifndef _WIN32
+    void* lib = dlopen("liblz4.so.1", RTLD_NOW);
+    if (!lib) lib = dlopen("liblz4.so", RTLD_NOW);
+    if (!lib) {
+        printf("lz4: liblz4 not found, the comparison with it is skipped\n");
+        return;
+    }
+    typedef int (*Compress)(const char*, char*, int, int);
+    typedef int (*Decompress)(const char*, char*, int, int);
+    Compress compress = (Compress)dlsym(lib, "LZ4_compress_default");
+    Decompress decompress = (Decompress)dlsym(lib, "LZ4_decompress_safe");
+    if (!compress || !decompress) {
+        printf("lz4: liblz4 has no LZ4_compress_default or LZ4_decompress_safe, the comparison with it is skipped\n");
+        dlclose(lib);
+        return;
+    }
+    int matches = 0;
+    for (auto& b : blocks) {
+        std::vector<unsigned char> packed(lz4Bound(b.size()) + 64), unpacked(b.size() + 1);
+        // written here, read by liblz4
+        size_t n = lz4Compress(b.data(), b.size(), packed.data());
+        int m = decompress((const char*)packed.data(), (char*)unpacked.data(), (int)n, (int)b.size());
+        bool ok = m == (int)b.size() && !memcmp(unpacked.data(), b.data(), b.size());
+        // written by liblz4, read here
+        int p = compress((const char*)b.data(), (char*)packed.data(), (int)b.size(), (int)packed.size());
+        long long q = p > 0 ? lz4Decompress(packed.data(), p, unpacked.data(), b.size()) : -1;
+        ok = ok && q == (long long)b.size() && !memcmp(unpacked.data(), b.data(), b.size());
+        check(ok, "lz4 blocks interchange with liblz4");
+        matches += ok;
+    }
+    printf("lz4: %d of %d blocks interchange with liblz4\n", matches, (int)blocks.size());
+    dlclose(lib);
+#endif
+}
+
+static void removeDataset(const std::string& path) {
+    remove((path + ".index").c_str());
+    for (int i = 0; i < 100; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), ".%03d.data", i);
+        remove((path + name).c_str());
+    }
+}
+
+static void checkDataset(const std::string& path) {
+    const int count = 120;
+    for (int compressed = 0; compressed < 2; compressed++) {
+        DatasetWriterDesc d;
+        d.chunkBytes = 200000;
+        d.maxFileBytes = 1 << 20;
+        d.isCompressed = compressed != 0;
+        DatasetWriter writer;
+        if (!writer.open(path, d)) {
+            check(false, "open the dataset for writing");
+            return;
+        }
+        std::vector<std::vector<unsigned char>> grays;
+        std::vector<std::vector<float>> poses;
+        for (int i = 0; i < count; i++) {
+            int w = 20 + next() % 100, h = 10 + next() % 60;
+            std::vector<unsigned char> gray((size_t)w * h);
+            for (auto& v : gray) v = next() % 4 ? 7 : (unsigned char)next();
+            std::vector<float> pos;
+            if (i % 2) {
+                pos.resize((size_t)w * h * 3);
+                for (auto& v : pos) v = next() % 3 ? 1e6f : (float)(next() % 10000) / 100;
+            }
+            DatasetRecord r;
+            r.width = w;
+            r.height = h;
+            r.outputs[DATASET_GRAY] = gray.data();
+            if (i % 2) r.outputs[DATASET_POS] = pos.data();
+            r.pose.tx = (float)i;
+            r.G = i * 0.5f;
+            check(writer.append(r) == i, "record ids count up from 0");
+            grays.push_back(gray);
+            poses.push_back(pos);
+        }
+        check(writer.close(), "close the dataset");
+
+        DatasetReader reader;
+        if (!reader.open(path)) {
+            check(false, "open the dataset for reading");
+            return;
+        }
+        check(reader.size() == count, "the reader sees every record");
+        int good = 0;
+        for (int i = count - 1; i >= 0; i--) {
+            DatasetRecordView v;
+            bool ok = reader.read(i, v) && v.entry.pose[0] == (float)i && v.gray
+                && !memcmp(v.gray, grays[i].data(), grays[i].size()) && (v.pos != NULL) == (i % 2 == 1)
+                && (!v.pos || !memcmp(v.pos, poses[i].data(), poses[i].size() * sizeof(float)))
+                && (size_t)v.gray % 64 == 0 && (!v.pos || (size_t)v.pos % 64 == 0);
+            if (ok && v.entry.codec == 0) ok = (v.entry.chunkOffset + v.entry.recordOffset) % 4096 == 0;
+            good += ok;
+        }
+        check(good == count, "records read back as written");
+        printf("dataset %s: %d of %d records read back\n", compressed ? "compressed" : "stored", good, count);
+        reader.close();
+    }
+
+    // a torn last entry is not counted
+    FILE* index = fopen((path + ".index").c_str(), "r+b");
+    if (!index) {
+        check(false, "reopen the index");
+        return;
+    }
+    fseek(index, 0, SEEK_END);
+    long bytes = ftell(index);
+    std::vector<unsigned char> all(bytes);
+    fseek(index, 0, SEEK_SET);
+    check(fread(all.data(), 1, all.size(), index) == all.size(), "read the index");
+    fclose(index);
+    FILE* torn = fopen((path + ".index").c_str(), "wb");
+    fwrite(all.data(), 1, all.size() - 100, torn);
+    fclose(torn);
+    DatasetReader reader;
+    check(reader.open(path) && reader.size() == count - 1, "a torn last entry is not counted");
+    reader.close();
+
+    // entries pointing outside their chunk or record are refused
+    struct Damage { const char* what; void (*apply)(DatasetIndexEntry&); };
+    const Damage damages[] = {
+        { "record past the chunk", [](DatasetIndexEntry& e) { e.recordOffset = e.chunkRawBytes; } },
+        { "record larger than the chunk", [](DatasetIndexEntry& e) { e.recordBytes = e.chunkRawBytes + 1; } },
+        { "output past the record", [](DatasetIndexEntry& e) { e.outputOffsets[DATASET_GRAY] = e.recordBytes; } },
+        { "output of the wrong size", [](DatasetIndexEntry& e) { e.outputBytes[DATASET_GRAY] += 4096; } },
+        { "unknown codec", [](DatasetIndexEntry& e) { e.codec = 7; } },
+    };
+    for (const Damage& damage : damages) {
+        std::vector<unsigned char> copy = all;
+        DatasetIndexEntry e;
+        memcpy(&e, &copy[sizeof(DatasetIndexEntry) * 6], sizeof(e));
+        damage.apply(e);
+        memcpy(&copy[sizeof(DatasetIndexEntry) * 6], &e, sizeof(e));
+        FILE* out = fopen((path + ".index").c_str(), "wb");
+        fwrite(copy.data(), 1, copy.size(), out);
+        fclose(out);
+        DatasetRecordView v;
+        bool refused = reader.open(path) && !reader.read(5, v) && reader.read(4, v);
+        reader.close();
+        std::string what = std::string("the reader refuses an entry with ") + damage.what;
+        check(refused, what.c_str());
+    }
+    removeDataset(path);
+}
+
+int main(int argc, char** argv) {
+    std::string path = "datasetcheck";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--path") && i + 1 < argc) path = argv[++i];
+        else {
+            printf("usage: %s [--path datasetcheck]\n", argv[0]);
+            return -1;
+        }
+    }
+    checkCodec();
+    checkDataset(path);
+    printf(failures ? "%d checks failed\n" : "every check passed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+uniform sampler2D seedTexture;
+
+// pixels to the nearest edge, 1e6 when there is no edge at all
+layout (location = 0) out float Distance;
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec2 s = texelFetch(seedTexture, p, 0).xy;
+    Distance = s.x < 0.0 ? 1e6 : length(s - vec2(p));
+}
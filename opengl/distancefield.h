@@ -0,0 +1,200 @@
+#ifndef DISTANCEFIELD_H
+#define DISTANCEFIELD_H
+
+#include <glad/glad.h>
+#include "shader.h"
+#include "programcache.h"
+#include <cmath>
+#include <cstdio>
+
+// distance in pixels to the nearest rendered edge, computed on the GPU from a pos output: contour.fs marks silhouette,
+// occlusion and crease pixels, jump flooding (jfa.fs, log2 of the size steps plus one extra step of 1) spreads the
+// nearest edge pixel to every pixel and distance.fs turns that into an R32F field.
+// chamfer() scores image edge points against the field without reading it back, the points are summed by additive
+// blending into a single RG32F pixel. the framebuffer binding and viewport are left changed, Render restores them.
+class DistanceField {
+public:
+    // largest output size, the textures are made on the first compute()
+    DistanceField(int width, int height) : width(width), height(height) {}
+    ~DistanceField() { release(); }
+
+    // w x h of posTexture from its bottom-left corner. creaseAngle in degrees, 180 or more turns creases off
+    void compute(unsigned int posTexture, int w, int h, float jumpThreshold, float creaseAngle) {
+        if (!fieldFBO) create();
+        usedWidth = w;
+        usedHeight = h;
+        glDisable(GL_BLEND);
+        glDisable(GL_SCISSOR_TEST);
+        glViewport(0, 0, w, h);
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, seedFBO[0]);
+        contourShader->use();
+        contourShader->setInt("posTexture", 0);
+        glUniform2i(glGetUniformLocation(contourShader->ID, "size"), w, h);
+        contourShader->setFloat("jumpThreshold", jumpThreshold);
+        contourShader->setFloat("creaseCos", creaseAngle >= 180 ? 2.0f : (float)std::cos(creaseAngle * 3.14159265358979 / 180));
+        glBindTexture(GL_TEXTURE_2D, posTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        int current = 0;
+        int step = 1;
+        while (step * 2 < std::max(w, h)) step *= 2;
+        jfaShader->use();
+        jfaShader->setInt("seedTexture", 0);
+        glUniform2i(glGetUniformLocation(jfaShader->ID, "size"), w, h);
+        // JFA+1: the final step of 1 again fixes most of the pixels plain jump flooding gets wrong
+        for (bool isExtra = false; step >= 1; ) {
+            jfaShader->setInt("step", step);
+            glBindFramebuffer(GL_FRAMEBUFFER, seedFBO[1 - current]);
+            glBindTexture(GL_TEXTURE_2D, seedTexture[current]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            current = 1 - current;
+            if (step == 1 && !isExtra) isExtra = true;
+            else step /= 2;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fieldFBO);
+        distanceShader->use();
+        distanceShader->setInt("seedTexture", 0);
+        glBindTexture(GL_TEXTURE_2D, seedTexture[current]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+    }
+
+    // mean distance of the points (x, y pairs, output pixels with bottom-left origin) inside the output to the nearest edge,
+    // each capped at truncation. inside receives how many points were inside, the result is -1 when none was
+    float chamfer(const float* points, int n, float truncation, int* inside = NULL) {
+        if (inside) *inside = 0;
+        if (!fieldFBO || n <= 0) return -1;
+        if (n > pointCapacity) {
+            glBindBuffer(GL_ARRAY_BUFFER, pointVBO);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)n * 2 * sizeof(float), NULL, GL_STREAM_DRAW);
+            pointCapacity = n;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, pointVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)n * 2 * sizeof(float), points);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sumFBO);
+        glViewport(0, 0, 1, 1);
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glBlendEquation(GL_FUNC_ADD);
+        chamferShader->use();
+        chamferShader->setInt("distanceTexture", 0);
+        chamferShader->setVec2("fieldSize", (float)width, (float)height);
+        chamferShader->setVec2("size", (float)usedWidth, (float)usedHeight);
+        chamferShader->setFloat("truncation", truncation);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, fieldTexture);
+        glBindVertexArray(pointVAO);
+        glDrawArrays(GL_POINTS, 0, n);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDisable(GL_BLEND);
+
+        float sum[2] = { 0, 0 };
+        glReadPixels(0, 0, 1, 1, GL_RG, GL_FLOAT, sum);
+        int count = (int)(sum[1] + 0.5f);
+        if (inside) *inside = count;
+        return count > 0 ? sum[0] / count : -1;
+    }
+
+    // the field of the last compute(), usedWidth x usedHeight floats, rows bottom-up
+    void read(float* dst) {
+        if (!fieldFBO) return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fieldFBO);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, usedWidth, usedHeight, GL_RED, GL_FLOAT, dst);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+
+    unsigned int getTexture() { return fieldTexture; }
+    // two RG32F seed textures and the R32F field once computed, plus the point buffer
+    size_t getGpuMemoryBytes() { return fieldFBO ? (size_t)width * height * (8 + 8 + 4) + 8 + (size_t)pointCapacity * 2 * sizeof(float) : 0; }
+    bool isComputed() { return fieldFBO != 0 && usedWidth > 0; }
+
+    void release() {
+        unsigned int textures[] = { seedTexture[0], seedTexture[1], fieldTexture, sumTexture };
+        unsigned int fbos[] = { seedFBO[0], seedFBO[1], fieldFBO, sumFBO };
+        for (unsigned int t : textures) if (t) glDeleteTextures(1, &t);
+        for (unsigned int f : fbos) if (f) glDeleteFramebuffers(1, &f);
+        if (emptyVAO) glDeleteVertexArrays(1, &emptyVAO);
+        if (pointVAO) glDeleteVertexArrays(1, &pointVAO);
+        if (pointVBO) glDeleteBuffers(1, &pointVBO);
+        seedTexture[0] = seedTexture[1] = fieldTexture = sumTexture = 0;
+        seedFBO[0] = seedFBO[1] = fieldFBO = sumFBO = 0;
+        emptyVAO = pointVAO = pointVBO = 0;
+        pointCapacity = 0;
+        usedWidth = usedHeight = 0;
+    }
+
+private:
+    int width;
+    int height;
+    int usedWidth = 0;
+    int usedHeight = 0;
+    unsigned int seedTexture[2] = { 0, 0 };    // RG32F nearest edge pixel, ping-ponged by the jump flooding steps
+    unsigned int seedFBO[2] = { 0, 0 };
+    unsigned int fieldTexture = 0;             // R32F distances
+    unsigned int fieldFBO = 0;
+    unsigned int sumTexture = 0;               // RG32F 1x1: sum of distances, number of points
+    unsigned int sumFBO = 0;
+    unsigned int emptyVAO = 0;
+    unsigned int pointVAO = 0;
+    unsigned int pointVBO = 0;
+    int pointCapacity = 0;
+    Shader* contourShader = NULL;
+    Shader* jfaShader = NULL;
+    Shader* distanceShader = NULL;
+    Shader* chamferShader = NULL;
+
+    unsigned int createTarget(unsigned int& fbo, GLenum internalFormat, GLenum format, int w, int h, GLenum filter) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: distance field framebuffer is not complete!" << std::endl;
+        return texture;
+    }
+
+    void create() {
+        seedTexture[0] = createTarget(seedFBO[0], GL_RG32F, GL_RG, width, height, GL_NEAREST);
+        seedTexture[1] = createTarget(seedFBO[1], GL_RG32F, GL_RG, width, height, GL_NEAREST);
+        fieldTexture = createTarget(fieldFBO, GL_R32F, GL_RED, width, height, GL_LINEAR);
+        sumTexture = createTarget(sumFBO, GL_RG32F, GL_RG, 1, 1, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenVertexArrays(1, &emptyVAO);
+        glGenVertexArrays(1, &pointVAO);
+        glGenBuffers(1, &pointVBO);
+        glBindVertexArray(pointVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, pointVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        ProgramCache& programs = ProgramCache::instance();
+        contourShader = programs.get("fullscreen.vs", "contour.fs");
+        jfaShader = programs.get("fullscreen.vs", "jfa.fs");
+        distanceShader = programs.get("fullscreen.vs", "distance.fs");
+        chamferShader = programs.get("chamfer.vs", "chamfer.fs");
+    }
+};
+
+#endif
@@ -0,0 +1,6 @@
+#version 330 core
+
+// never runs, the transform feedback passes (idCompact, keypoint) draw with GL_RASTERIZER_DISCARD
+void main()
+{
+}
@@ -0,0 +1,44 @@
+#ifndef GLCONTEXT_H
+#define GLCONTEXT_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <cstdlib>
+#include <iostream>
+
+// creates a 3.3 core context and loads the GL functions.
+// headless hides the window, all rendering goes to framebuffer objects anyway.
+// software asks Mesa for its llvmpipe rasterizer, which needs no GPU at all (ignored by other drivers).
+inline GLFWwindow* createGLContext(int width, int height, bool isHeadless = false, bool isSoftware = false)
+{
+    if (isSoftware) {
+#ifdef _WIN32
+        _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+        _putenv_s("GALLIUM_DRIVER", "llvmpipe");
+#else
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+        setenv("GALLIUM_DRIVER", "llvmpipe", 1);
+#endif
+    }
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (isHeadless) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(width, height, "Plane", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        exit(-1);
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        exit(-1);
+    }
+    return window;
+}
+
+#endif
@@ -0,0 +1,160 @@
+// checks the analytic gradients of SoftRaster against central differences.
+// separate executable, build it from this file and glad.c instead of kernel.cpp. the GL context is only needed to create
+// the models, SoftRaster itself runs on the CPU.
+//
+//   gradcheck [--software] [--tolerance 0.01]
+//
+// renders a body and a bent wing at a fixed pose, then for each of tx, ty, tz, rx, ry, rz and G compares the per pixel
+// dS and dI with (f(p + h) - f(p - h)) / 2h. the error printed is the RMS difference over the RMS of the finite difference.
+// correct gradients stay under 0.6%: smaller steps lose more to float cancellation than they gain, larger ones see the
+// curvature of the sigmoid. a sign error in the depth term alone already shows as 2%. also checks that J^T r of the
+// result matches the per pixel gradients. returns 0 when every error is below the tolerance.
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define _CRT_SECURE_NO_WARNINGS
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <Eigen/Dense>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "stb_image_write.h"
+#include "shader.h"
+#include "model.h"
+#include "camera.h"
+#include "render.h"
+#include "softraster.h"
+#include "glcontext.h"
+
+// an n x n grid of quads over [x0, x1] x [y0, y1], tilted in z so that neither depth nor its derivatives are constant
+static Mesh makeGridMesh(float x0, float y0, float x1, float y1, float z, int n, float gray) {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    for (int i = 0; i <= n; i++) {
+        for (int j = 0; j <= n; j++) {
+            Vertex v;
+            float x = x0 + (x1 - x0) * j / n, y = y0 + (y1 - y0) * i / n;
+            v.Position = V3f(x, y, z + 0.3f * x);
+            v.Normal = V3f(0, 0, 1);
+            v.TexCoords = Eigen::Vector2f((float)j / n, (float)i / n);
+            v.Tangent = V3f::Zero();
+            v.Bitangent = V3f::Zero();
+            vertices.push_back(v);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            unsigned int a = i * (n + 1) + j, b = a + 1, c = a + n + 1, d = c + 1;
+            unsigned int quad[] = { a, b, d, a, d, c };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    aiColor4D color;
+    color.r = color.g = color.b = gray;
+    color.a = 1;
+    return Mesh(vertices, indices, std::vector<Texture>(), color);
+}
+
+int main(int argc, char** argv) {
+    bool isSoftware = false;
+    float tolerance = 0.01f;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--software")) isSoftware = true;
+        else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) tolerance = (float)atof(argv[++i]);
+        else {
+            printf("usage: %s [--software] [--tolerance 0.01]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    const int width = 64, height = 48;
+    GLFWwindow* window = createGLContext(width, height, true, isSoftware);
+    CameraPara C;
+    C.width = (float)width; C.height = (float)height;
+    C.f = 16; C.dx = 0.01f; C.dy = 0.01f;
+    C.x0 = C.width / 2; C.y0 = C.height / 2;
+    Camera camera(C, V3f(0, 0, 0));
+    Model* body = new Model(std::vector<Mesh>{ makeGridMesh(-6, -4, 5, 3, 0, 4, 0.8f) });
+    Model* wing = new Model(std::vector<Mesh>{ makeGridMesh(-2, -6, 7, 1, 2, 4, 0.45f) });
+
+    SoftRasterDesc desc;
+    desc.camera = &camera;
+    desc.bodyModel = body;
+    desc.wingModel = wing;
+    desc.sigma = 2;
+    desc.gamma = 1e-3f;
+    desc.backgroundGray = 20;
+    SoftRaster raster(desc);
+
+    ModelTransformDesc pose;
+    pose.tx = 0.5f; pose.ty = -0.3f; pose.tz = -1000;
+    pose.rx = 0.1f; pose.ry = -0.05f; pose.rz = 0.3f;
+    float G = 1.5f;
+    // steps of the central differences, a fraction of a pixel of motion each
+    const char* names[SoftRaster::PARAMETERS] = { "tx", "ty", "tz", "rx", "ry", "rz", "G" };
+    const float steps[SoftRaster::PARAMETERS] = { 5e-3f, 5e-3f, 5e-2f, 1e-4f, 1e-4f, 5e-5f, 5e-2f };
+
+    const int n = width * height, P = SoftRaster::PARAMETERS;
+    std::vector<float> S(n), I(n), dS((size_t)n * P), dI((size_t)n * P), S1(n), I1(n), S2(n), I2(n);
+    SoftRasterOutput out;
+    out.silhouette = S.data();
+    out.gray = I.data();
+    out.silhouetteGradient = dS.data();
+    out.grayGradient = dI.data();
+    SoftRasterResult result;
+    raster.render(pose, G, result, &out);
+
+    bool isPassed = true;
+    printf("parameter  silhouette error  gray error\n");
+    for (int k = 0; k < P; k++) {
+        ModelTransformDesc plus = pose, minus = pose;
+        float Gplus = G, Gminus = G;
+        float* p[SoftRaster::PARAMETERS] = { &plus.tx, &plus.ty, &plus.tz, &plus.rx, &plus.ry, &plus.rz, &Gplus };
+        float* m[SoftRaster::PARAMETERS] = { &minus.tx, &minus.ty, &minus.tz, &minus.rx, &minus.ry, &minus.rz, &Gminus };
+        *p[k] += steps[k];
+        *m[k] -= steps[k];
+        SoftRasterOutput outPlus, outMinus;
+        outPlus.silhouette = S1.data(); outPlus.gray = I1.data();
+        outMinus.silhouette = S2.data(); outMinus.gray = I2.data();
+        SoftRasterResult unused;
+        raster.render(plus, Gplus, unused, &outPlus);
+        raster.render(minus, Gminus, unused, &outMinus);
+
+        double errorS = 0, normS = 0, errorI = 0, normI = 0;
+        for (int i = 0; i < n; i++) {
+            double fdS = (S1[i] - S2[i]) / (2.0 * steps[k]), fdI = (I1[i] - I2[i]) / (2.0 * steps[k]);
+            errorS += (fdS - dS[(size_t)i * P + k]) * (fdS - dS[(size_t)i * P + k]);
+            errorI += (fdI - dI[(size_t)i * P + k]) * (fdI - dI[(size_t)i * P + k]);
+            normS += fdS * fdS;
+            normI += fdI * fdI;
+        }
+        double relS = normS > 0 ? std::sqrt(errorS / normS) : std::sqrt(errorS);
+        double relI = normI > 0 ? std::sqrt(errorI / normI) : std::sqrt(errorI);
+        bool isOk = relS < tolerance && relI < tolerance;
+        isPassed = isPassed && isOk;
+        printf("%-9s  %16.4f  %10.4f%s\n", names[k], relS, relI, isOk ? "" : "  FAILED");
+    }
+
+    // without references the residuals are S and I themselves
+    double worst = 0;
+    for (int k = 0; k < P; k++) {
+        double JtrS = 0, JtrI = 0;
+        for (int i = 0; i < n; i++) {
+            JtrS += (double)dS[(size_t)i * P + k] * S[i];
+            JtrI += (double)dI[(size_t)i * P + k] * I[i];
+        }
+        worst = std::max(worst, std::fabs(result.silhouette.Jtr[k] - JtrS) / std::max(std::fabs(JtrS), 1e-6));
+        worst = std::max(worst, std::fabs(result.gray.Jtr[k] - JtrI) / std::max(std::fabs(JtrI), 1e-6));
+    }
+    printf("J^T r against the per pixel gradients: %.2e relative%s\n", worst, worst < 1e-4 ? "" : "  FAILED");
+    isPassed = isPassed && worst < 1e-4;
+
+    printf(isPassed ? "gradients match\n" : "gradients do not match\n");
+    delete wing;
+    delete body;
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return isPassed ? 0 : 1;
+}
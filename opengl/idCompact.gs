@@ -0,0 +1,22 @@
+#version 330 core
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+flat in int Pixel[];
+
+// captured by transform feedback: x, y, mesh index, triangle
+flat out uvec4 Record;
+
+uniform usampler2D idTexture;
+uniform int width;
+
+void main()
+{
+    ivec2 p = ivec2(Pixel[0] % width, Pixel[0] / width);
+    uvec2 id = texelFetch(idTexture, p, 0).xy;
+    if (id.x == 0u) return;
+    Record = uvec4(uvec2(p), id.x - 1u, id.y);
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+    EmitVertex();
+    EndPrimitive();
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+// one point per output pixel, drawn without vertex buffers. idCompact.gs keeps the covered ones
+flat out int Pixel;
+
+void main()
+{
+    Pixel = gl_VertexID;
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+}
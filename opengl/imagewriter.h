@@ -0,0 +1,233 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// writes an 8 bit gray or RGB image to disk a few rows at a time, top row first, so the whole image never has to be in memory.
+class RowWriter {
+public:
+    virtual ~RowWriter() { if (fp) fclose(fp); }
+
+    virtual bool open(std::string const& path, int width, int height, int channels) {
+        this->width = width;
+        this->height = height;
+        this->channels = channels;
+        rowsWritten = 0;
+        fp = fopen(path.c_str(), "wb");
+        if (!fp) printf("can not open %s for writing\n", path.c_str());
+        return fp != NULL;
+    }
+
+    // `count` tightly packed rows
+    virtual void writeRows(const unsigned char* rows, int count) = 0;
+
+    virtual bool close() {
+        bool ok = fp && rowsWritten == height;
+        if (fp) fclose(fp);
+        fp = NULL;
+        return ok;
+    }
+
+protected:
+    FILE* fp = NULL;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    int rowsWritten = 0;
+
+    void put(const void* data, size_t bytes) { fwrite(data, 1, bytes, fp); }
+    void put32le(unsigned int v) { unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) }; put(b, 4); }
+    void put16le(unsigned int v) { unsigned char b[2] = { (unsigned char)v, (unsigned char)(v >> 8) }; put(b, 2); }
+    void put32be(unsigned int v) { unsigned char b[4] = { (unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v }; put(b, 4); }
+};
+
+// headerless pixels, the size has to be known by the reader
+class RawRowWriter : public RowWriter {
+public:
+    void writeRows(const unsigned char* rows, int count) {
+        put(rows, (size_t)width * channels * count);
+        rowsWritten += count;
+    }
+};
+
+// uncompressed baseline TIFF, one strip per row. the strip tables are written after the pixels, so nothing has to be patched
+// except the first IFD offset in the header. classic TIFF offsets are 32 bit, images have to stay below 4 GB.
+class TiffRowWriter : public RowWriter {
+public:
+    bool open(std::string const& path, int width, int height, int channels) {
+        if ((double)width * height * channels > 4.0e9) {
+            printf("%dx%dx%d is too large for a classic TIFF, use a .raw output\n", width, height, channels);
+            return false;
+        }
+        if (!RowWriter::open(path, width, height, channels)) return false;
+        put("II*\0", 4);
+        put32le(0); // IFD offset, patched in close()
+        offset = 8;
+        return true;
+    }
+
+    void writeRows(const unsigned char* rows, int count) {
+        size_t rowBytes = (size_t)width * channels;
+        put(rows, rowBytes * count);
+        for (int i = 0; i < count; i++) {
+            stripOffsets.push_back(offset);
+            offset += (unsigned int)rowBytes;
+        }
+        rowsWritten += count;
+    }
+
+    bool close() {
+        if (!fp) return false;
+        unsigned int rowBytes = (unsigned int)(width * channels);
+        // the IFD has to start on a word boundary
+        if (offset & 1) { put("\0", 1); offset++; }
+        unsigned int stripOffsetsPos = offset;
+        for (unsigned int o : stripOffsets) put32le(o);
+        unsigned int stripCountsPos = stripOffsetsPos + 4 * (unsigned int)stripOffsets.size();
+        for (size_t i = 0; i < stripOffsets.size(); i++) put32le(rowBytes);
+        unsigned int bitsPos = stripCountsPos + 4 * (unsigned int)stripOffsets.size();
+        for (int c = 0; c < channels; c++) put16le(8);
+        unsigned int ifdPos = bitsPos + 2 * channels;
+        if (ifdPos & 1) { put("\0", 1); ifdPos++; }
+
+        unsigned int strips = (unsigned int)stripOffsets.size();
+        struct Entry { unsigned short tag, type; unsigned int count, value; };
+        std::vector<Entry> entries = {
+            { 256, 4, 1, (unsigned int)width },                     // ImageWidth
+            { 257, 4, 1, (unsigned int)height },                    // ImageLength
+            { 258, 3, (unsigned int)channels, channels == 1 ? 8u : bitsPos }, // BitsPerSample
+            { 259, 3, 1, 1 },                                       // Compression: none
+            { 262, 3, 1, channels == 1 ? 1u : 2u },                 // Photometric: black is zero / RGB
+            { 273, 4, strips, strips == 1 ? stripOffsets[0] : stripOffsetsPos }, // StripOffsets
+            { 277, 3, 1, (unsigned int)channels },                  // SamplesPerPixel
+            { 278, 4, 1, 1 },                                       // RowsPerStrip
+            { 279, 4, strips, strips == 1 ? rowBytes : stripCountsPos }, // StripByteCounts
+            { 284, 3, 1, 1 },                                       // PlanarConfiguration: chunky
+        };
+        put16le((unsigned int)entries.size());
+        for (auto& e : entries) {
+            put16le(e.tag);
+            put16le(e.type);
+            put32le(e.count);
+            // SHORT values live in the low bytes of the value field
+            if (e.type == 3 && e.count == 1) { put16le(e.value); put16le(0); }
+            else put32le(e.value);
+        }
+        put32le(0); // no next IFD
+        fseek(fp, 4, SEEK_SET);
+        put32le(ifdPos);
+        return RowWriter::close();
+    }
+
+private:
+    unsigned int offset = 0;
+    std::vector<unsigned int> stripOffsets;
+};
+
+// PNG with stored (uncompressed) deflate blocks. stb_image_write can only compress a whole image held in memory,
+// a streamed PNG needs one deflate stream over all rows, which stored blocks give without a compressor.
+class PngRowWriter : public RowWriter {
+public:
+    bool open(std::string const& path, int width, int height, int channels) {
+        if (!RowWriter::open(path, width, height, channels)) return false;
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            crcTable[n] = c;
+        }
+        put("\x89PNG\r\n\x1a\n", 8);
+        unsigned char ihdr[13];
+        be32(ihdr, width);
+        be32(ihdr + 4, height);
+        ihdr[8] = 8;                        // bit depth
+        ihdr[9] = channels == 1 ? 0 : 2;    // gray / RGB
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;
+        chunk("IHDR", ihdr, 13);
+        // zlib header: deflate, 32K window, no preset dictionary, fastest level
+        pending.push_back(0x78);
+        pending.push_back(0x01);
+        return true;
+    }
+
+    void writeRows(const unsigned char* rows, int count) {
+        size_t rowBytes = (size_t)width * channels;
+        for (int r = 0; r < count; r++) {
+            unsigned char filter = 0;
+            deflateStored(&filter, 1);
+            deflateStored(rows + r * rowBytes, rowBytes);
+        }
+        flushBlock(false);
+        chunk("IDAT", pending.data(), pending.size());
+        pending.clear();
+        rowsWritten += count;
+    }
+
+    bool close() {
+        if (!fp) return false;
+        flushBlock(true);
+        unsigned char adler[4];
+        be32(adler, (b << 16) | a);
+        pending.insert(pending.end(), adler, adler + 4);
+        chunk("IDAT", pending.data(), pending.size());
+        chunk("IEND", NULL, 0);
+        return RowWriter::close();
+    }
+
+private:
+    unsigned int crcTable[256];
+    std::vector<unsigned char> pending;   // bytes of the zlib stream not yet wrapped into an IDAT chunk
+    std::vector<unsigned char> block;     // payload of the current stored block
+    unsigned int a = 1, b = 0;            // adler32 of the uncompressed data
+
+    static void be32(unsigned char* p, unsigned int v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+
+    void deflateStored(const unsigned char* data, size_t bytes) {
+        for (size_t i = 0; i < bytes; i++) {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        while (bytes) {
+            size_t n = std::min(bytes, (size_t)65535 - block.size());
+            block.insert(block.end(), data, data + n);
+            data += n;
+            bytes -= n;
+            if (block.size() == 65535) flushBlock(false);
+        }
+    }
+
+    // stored block header: BFINAL bit, BTYPE 00, then LEN and its complement, little endian
+    void flushBlock(bool isFinal) {
+        if (block.empty() && !isFinal) return;
+        unsigned int len = (unsigned int)block.size();
+        unsigned char header[5] = { (unsigned char)(isFinal ? 1 : 0), (unsigned char)len, (unsigned char)(len >> 8),
+            (unsigned char)~len, (unsigned char)(~len >> 8) };
+        pending.insert(pending.end(), header, header + 5);
+        pending.insert(pending.end(), block.begin(), block.end());
+        block.clear();
+    }
+
+    void chunk(const char* type, const unsigned char* data, size_t bytes) {
+        put32be((unsigned int)bytes);
+        unsigned int crc = 0xffffffffu;
+        for (int i = 0; i < 4; i++) crc = crcTable[(crc ^ (unsigned char)type[i]) & 0xff] ^ (crc >> 8);
+        for (size_t i = 0; i < bytes; i++) crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        put(type, 4);
+        if (bytes) put(data, bytes);
+        put32be(crc ^ 0xffffffffu);
+    }
+};
+
+// picks the writer from the file extension: .png, .tif/.tiff, anything else is raw
+inline RowWriter* createRowWriter(std::string const& path) {
+    std::string ext = path.substr(path.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == "png") return new PngRowWriter();
+    if (ext == "tif" || ext == "tiff") return new TiffRowWriter();
+    return new RawRowWriter();
+}
+
+#endif
@@ -0,0 +1,21 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+in vec3 VertexPos[];
+flat in int VertexVariant[];
+
+out vec3 Pos;
+
+// the instance of jacobian.vs picks the layer, gl_Layer can not be written before the geometry stage in 3.3
+void main()
+{
+    for (int i = 0; i < 3; i++) {
+        gl_Layer = VertexVariant[0];
+        gl_PrimitiveID = gl_PrimitiveIDIn;
+        Pos = VertexPos[i];
+        gl_Position = gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,27 @@
+#version 330 core
+#define VARIANTS 15
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 VertexPos;
+flat out int VertexVariant;
+
+// perspective * view of the camera
+uniform mat4 viewProjection;
+// one instance per pose variant, see PoseJacobian
+uniform mat4 variantModel[VARIANTS];
+uniform float variantG[VARIANTS];
+uniform bool isDeformed;
+
+// wingOffset() and WING_REFERENCE_G are inserted by WingCalibration::shaderSource(), see wingShader.vs
+
+void main()
+{
+    int v = gl_InstanceID;
+    vec3 p = aPos;
+    if (isDeformed) p.z = p.z + wingOffset(aPos) * (variantG[v] / WING_REFERENCE_G);
+    VertexPos = p;
+    VertexVariant = v;
+    gl_Position = viewProjection * variantModel[v] * vec4(p, 1.0);
+}
@@ -0,0 +1,45 @@
+#version 330 core
+#define PARAMETERS 7
+
+// layer 0 the current pose, layers 1 + 2k and 2 + 2k the pose with parameter k raised and lowered by delta[k]
+uniform sampler2DArray variantTexture;
+uniform sampler2D referenceTexture;
+uniform float delta[PARAMETERS];
+uniform ivec2 size;
+
+// row i of J^T J, J^T r and the cost, summed along one image row
+layout (location = 0) out vec4 JtJ0;
+layout (location = 1) out vec4 JtJ1Jtr;
+layout (location = 2) out vec4 Cost;
+
+// one fragment per image row and parameter i. residuals and derivatives are in gray levels
+void main()
+{
+    int row = int(gl_FragCoord.x);
+    int i = int(gl_FragCoord.y);
+    float jtj[PARAMETERS];
+    for (int k = 0; k < PARAMETERS; k++) jtj[k] = 0.0;
+    float jtr = 0.0;
+    float cost = 0.0;
+    float pixels = 0.0;
+    if (row < size.y) {
+        for (int x = 0; x < size.x; x++) {
+            float r = (texelFetch(variantTexture, ivec3(x, row, 0), 0).r - texelFetch(referenceTexture, ivec2(x, row), 0).r) * 255.0;
+            float J[PARAMETERS];
+            bool isInformative = false;
+            for (int k = 0; k < PARAMETERS; k++) {
+                float plus = texelFetch(variantTexture, ivec3(x, row, 1 + 2 * k), 0).r;
+                float minus = texelFetch(variantTexture, ivec3(x, row, 2 + 2 * k), 0).r;
+                J[k] = (plus - minus) * 255.0 / (2.0 * delta[k]);
+                isInformative = isInformative || J[k] != 0.0;
+            }
+            for (int k = 0; k < PARAMETERS; k++) jtj[k] += J[i] * J[k];
+            jtr += J[i] * r;
+            cost += r * r;
+            if (isInformative) pixels += 1.0;
+        }
+    }
+    JtJ0 = vec4(jtj[0], jtj[1], jtj[2], jtj[3]);
+    JtJ1Jtr = vec4(jtj[4], jtj[5], jtj[6], jtr);
+    Cost = vec4(cost, pixels, 0.0, 0.0);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+
+// jacobianRows.fs outputs, a column per image row
+uniform sampler2D rows0;
+uniform sampler2D rows1;
+uniform sampler2D rows2;
+uniform int rowCount;
+
+layout (location = 0) out vec4 JtJ0;
+layout (location = 1) out vec4 JtJ1Jtr;
+layout (location = 2) out vec4 Cost;
+
+// one fragment per parameter: the row sums of the whole image
+void main()
+{
+    int i = int(gl_FragCoord.y);
+    vec4 s0 = vec4(0.0), s1 = vec4(0.0), s2 = vec4(0.0);
+    for (int row = 0; row < rowCount; row++) {
+        s0 += texelFetch(rows0, ivec2(row, i), 0);
+        s1 += texelFetch(rows1, ivec2(row, i), 0);
+        s2 += texelFetch(rows2, ivec2(row, i), 0);
+    }
+    JtJ0 = s0;
+    JtJ1Jtr = s1;
+    Cost = s2;
+}
@@ -0,0 +1,31 @@
+#version 330 core
+
+// nearest seed found so far per pixel, -1 where none
+uniform sampler2D seedTexture;
+uniform ivec2 size;
+uniform int step;
+
+layout (location = 0) out vec2 Seed;
+
+// one jump flooding step: keep the nearest of the seeds known to the 3x3 pixels `step` apart
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec2 best = vec2(-1.0);
+    float bestDistance = 1e20;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 q = p + ivec2(x, y) * step;
+            if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size))) continue;
+            vec2 s = texelFetch(seedTexture, q, 0).xy;
+            if (s.x < 0.0) continue;
+            vec2 d = s - vec2(p);
+            float dd = dot(d, d);
+            if (dd < bestDistance) {
+                bestDistance = dd;
+                best = s;
+            }
+        }
+    }
+    Seed = best;
+}
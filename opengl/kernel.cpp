@@ -13,25 +13,10 @@
 #include "model.h"
 #include "camera.h"
 #include "render.h"
+#include "glcontext.h"
 
 void custom_glfwInit(CameraPara& C) {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow* window = glfwCreateWindow(C.width, C.height, "Plane", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        exit(-1);
-    }
-    glfwMakeContextCurrent(window);
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        exit(-1);
-    }
+    createGLContext(C.width, C.height);
 }
 
 int main() {
@@ -62,11 +47,13 @@ int main() {
     ModelTransformDesc td;
     td.scale = 0.0254;
 
+    RenderProfiler profiler;
     RenderDesc desc;
     desc.bodyModel = &bodyModel;
     desc.wingModel = &wingModel;
     desc.camera = &ourCamera;
     desc.tranDesc = &td;
+    desc.profiler = &profiler;
     desc.bgImagePath = "origin2.png";
     desc.isMSAAEnable = false;
     desc.isRenderBackGround = false;
@@ -77,8 +64,10 @@ int main() {
     render.generateImage("output.png");
     //render.getDepthInfo();
 
+    profiler.dump();
+
     end = clock();
-    std::cout << (float)(end - start) / 1000 << std::endl;
+    std::cout << (float)(end - start) / CLOCKS_PER_SEC << std::endl;
 
     int a;
 }
@@ -0,0 +1,36 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in float aDeformed;
+
+// captured by transform feedback, see RenderKeypoint
+out vec3 Projected;
+flat out uint Visible;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 perspective;
+uniform float G;
+// model space positions of the last draw, 1e6 where nothing was drawn
+uniform sampler2D posTexture;
+uniform vec2 outputSize;
+// how far in front of the point the drawn surface may be before it hides the point
+uniform float tolerance;
+
+// wingOffset() and WING_REFERENCE_G are inserted by WingCalibration::shaderSource(), see wingShader.vs
+
+void main()
+{
+    vec3 p = aPos;
+    if (aDeformed > 0.5) p.z = p.z + wingOffset(aPos) * (G / WING_REFERENCE_G);
+    vec4 viewPos = view * model * vec4(p, 1.0);
+    vec4 clip = perspective * viewPos;
+    vec2 pixel = (clip.xy / clip.w * 0.5 + 0.5) * outputSize;
+    Visible = 0u;
+    if (clip.w > 0.0 && abs(clip.z) <= clip.w && all(greaterThanEqual(pixel, vec2(0.0))) && all(lessThan(pixel, outputSize))) {
+        vec3 surface = texelFetch(posTexture, ivec2(pixel), 0).xyz;
+        // the camera looks down -z, a surface in front of the point has the larger z
+        if (surface.x > 1e5 || (view * model * vec4(surface, 1.0)).z <= viewPos.z + tolerance) Visible = 1u;
+    }
+    Projected = vec3(pixel, -viewPos.z);
+    gl_Position = clip;
+}
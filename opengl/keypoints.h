@@ -0,0 +1,80 @@
+#ifndef KEYPOINTS_H
+#define KEYPOINTS_H
+
+#include <glad/glad.h>
+#include "model.h"
+#include <vector>
+
+// a keypoint projected by Render::projectKeypoints
+struct RenderKeypoint {
+    float x;                    // output pixel coordinates, bottom-left origin, pixel centres at .5 like gl_FragCoord
+    float y;
+    float depth;                // distance in front of the camera along its axis
+    unsigned int visible;       // 1 when inside the output and not hidden behind a drawn surface
+};
+
+// model space points to project, uploaded once and projected on the GPU each frame. deformed points are bent by the
+// wing load G exactly like an undeformed wing model drawn by Render
+class KeypointSet {
+public:
+    void add(const V3f& p, bool isDeformed = false) {
+        points.push_back(p.x());
+        points.push_back(p.y());
+        points.push_back(p.z());
+        points.push_back(isDeformed ? 1.0f : 0.0f);
+        isBuilt = false;
+    }
+
+    // every vertex of the model, in mesh order
+    void addModel(Model* model, bool isDeformed = false) {
+        for (auto& mesh : model->meshes)
+            for (auto& v : mesh.vertices) add(v.Position, isDeformed);
+    }
+
+    void clear() {
+        points.clear();
+        isBuilt = false;
+    }
+
+    int size() { return (int)(points.size() / 4); }
+
+    V3f getPoint(int i) { return V3f(points[i * 4], points[i * 4 + 1], points[i * 4 + 2]); }
+
+    // upload the points, done by Render when points were added since the last build
+    void build() {
+        if (!VAO) {
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+        }
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(float), points.empty() ? NULL : points.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(3 * sizeof(float)));
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        isBuilt = true;
+    }
+
+    unsigned int getVAO() {
+        if (!isBuilt) build();
+        return VAO;
+    }
+
+    void release() {
+        if (VAO) glDeleteVertexArrays(1, &VAO);
+        if (VBO) glDeleteBuffers(1, &VBO);
+        VAO = VBO = 0;
+        isBuilt = false;
+    }
+
+private:
+    std::vector<float> points;  // x, y, z, deformed
+    bool isBuilt = false;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+};
+
+#endif
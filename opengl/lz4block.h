@@ -0,0 +1,97 @@
+#ifndef LZ4BLOCK_H
+#define LZ4BLOCK_H
+
+#include <cstring>
+#include <vector>
+
+// the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md) with a plain greedy matcher, so that
+// blocks written here can also be read by liblz4's LZ4_decompress_safe and the other way round. fast rather than small:
+// one hash probe per position, and positions are skipped faster the longer nothing matches, as in LZ4 itself.
+
+// largest compressed size of n bytes
+inline size_t lz4Bound(size_t n) { return n + n / 255 + 16; }
+
+// compresses n bytes of src into dst, which must hold lz4Bound(n). returns the compressed size
+inline size_t lz4Compress(const unsigned char* src, size_t n, unsigned char* dst) {
+    const size_t minMatch = 4, lastLiterals = 5, matchFindLimit = 12;
+    const int hashBits = 16;
+    std::vector<unsigned int> table((size_t)1 << hashBits, 0);     // position + 1, 0 is empty
+    auto read32 = [](const unsigned char* p) { unsigned int v; memcpy(&v, p, 4); return v; };
+    auto hash = [&](unsigned int v) { return (v * 2654435761u) >> (32 - hashBits); };
+    unsigned char* op = dst;
+    auto putLength = [&](size_t length) {
+        for (; length >= 255; length -= 255) *op++ = 255;
+        *op++ = (unsigned char)length;
+    };
+    auto putSequence = [&](const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength) {
+        unsigned char* token = op++;
+        *token = (unsigned char)((literalLength >= 15 ? 15 : literalLength) << 4);
+        if (literalLength >= 15) putLength(literalLength - 15);
+        memcpy(op, literals, literalLength);
+        op += literalLength;
+        if (matchLength == 0) return;
+        *op++ = (unsigned char)offset;
+        *op++ = (unsigned char)(offset >> 8);
+        size_t m = matchLength - minMatch;
+        *token |= (unsigned char)(m >= 15 ? 15 : m);
+        if (m >= 15) putLength(m - 15);
+    };
+
+    size_t ip = 0, anchor = 0, misses = 0;
+    // the last match has to start 12 bytes and end 5 bytes before the end of the block
+    while (n > matchFindLimit && ip < n - matchFindLimit) {
+        unsigned int sequence = read32(src + ip);
+        unsigned int h = hash(sequence);
+        size_t candidate = table[h];
+        table[h] = (unsigned int)ip + 1;
+        if (candidate > 0 && ip - (candidate - 1) <= 65535 && read32(src + candidate - 1) == sequence) {
+            size_t ref = candidate - 1;
+            size_t length = minMatch;
+            while (ip + length < n - lastLiterals && src[ref + length] == src[ip + length]) length++;
+            putSequence(src + anchor, ip - anchor, ip - ref, length);
+            ip += length;
+            anchor = ip;
+            misses = 0;
+        }
+        else ip += 1 + (misses++ >> 6);
+    }
+    putSequence(src + anchor, n - anchor, 0, 0);
+    return (size_t)(op - dst);
+}
+
+// decompresses a block into dst of capacity bytes, returns the decompressed size or -1 for a malformed block
+inline long long lz4Decompress(const unsigned char* src, size_t n, unsigned char* dst, size_t capacity) {
+    const unsigned char* ip = src, * end = src + n;
+    size_t op = 0;
+    auto getLength = [&](size_t& length) {
+        unsigned char b;
+        do {
+            if (ip >= end) return false;
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    };
+    while (ip < end) {
+        unsigned char token = *ip++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !getLength(literalLength)) return -1;
+        if (literalLength > (size_t)(end - ip) || literalLength > capacity - op) return -1;
+        memcpy(dst + op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+        if (ip == end) break;       // the last sequence has literals only
+        if (end - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !getLength(matchLength)) return -1;
+        matchLength += 4;
+        if (offset == 0 || offset > op || matchLength > capacity - op) return -1;
+        // byte by byte, matches may overlap the bytes they produce
+        for (size_t i = 0; i < matchLength; i++, op++) dst[op] = dst[op - offset];
+    }
+    return (long long)op;
+}
+
+#endif
@@ -88,10 +88,32 @@ public:
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
+    // instances copies of the mesh in one call, the shader tells them apart by gl_InstanceID. textures are not bound
+    void DrawInstanced(Shader& shader, int instances)
+    {
+        shader.setVec4("color", Eigen::Vector4f(colors.r, colors.g, colors.b, colors.a));
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instances);
+        glBindVertexArray(0);
+    }
     void setup() {
         setupMesh();
     }
 
+    // upload changed vertices into the existing vertex buffer, the number of vertices must not have changed
+    void updateVertices() {
+        if (vertices.empty()) return;
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), &vertices[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void release() {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+    }
+
 private:
     // render data 
     unsigned int VBO;
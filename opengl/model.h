@@ -12,6 +12,7 @@
 
 #include "mesh.h"
 #include "shader.h"
+#include "wingcalib.h"
 
 #include <string>
 #include <fstream>
@@ -22,6 +23,13 @@
 
 unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
 
+// a new number for each Model and Scene created and each change of their geometry, never handed out twice. caches
+// key on it instead of the address, which a later object can get again. GL thread only, like the rest of them
+inline unsigned long long nextGeneration() {
+    static unsigned long long generation = 0;
+    return ++generation;
+}
+
 class Model
 {
 public:
@@ -30,25 +38,35 @@ public:
     std::vector<Mesh>    meshes;
     std::string directory;
     aiScene* pscene;
-    int wingCalibCoefLen;
-    float wingCalibCoefFront[7] = { -6.279e-23, 1.302e-28, 4.245e-14, 2.873e-19, 2.453e-06, -5.177e-11, -54.852 };
-    float wingCalibCoefBack[7] = { -5.503e-23, -8.618e-21, 3.599e-14, 5.498e-12, 3.816e-06, -3.007e-04, -66.54 };
+    int wingCalibCoefLen = 0;
+    // bending of the wing, the wing shaders are generated from the same description
+    WingCalibration wingCalib;
     float wingCalibG;
+    // renewed by wingTransform() and calibrateWing(), set it to nextGeneration() after changing meshes by hand
+    unsigned long long generation = nextGeneration();
 
     // constructor, expects a filepath to a 3D model.
     Model(std::string const& path, int len, float G): wingCalibCoefLen(len), wingCalibG(G)
     {
+        wingCalib.degree = len;
         // expects a wing model that needs to be calibrated
-        pscene = new aiScene;
+        pscene = NULL;
         loadModel(path);
+        calibrateWing(G);
     }
 
     Model(std::string const& path)
     {
-        pscene = new aiScene;
+        pscene = NULL;
         loadModel(path);
     }
 
+    // model built in code (procedural geometry, tests), no file and no aiScene behind it
+    Model(std::vector<Mesh> const& meshes): meshes(meshes)
+    {
+        pscene = NULL;
+    }
+
     void saveModel(std::string const& path = "./model/output.obj") {
         Assimp::Exporter exporter;
         exporter.Export(pscene, "obj", path);
@@ -62,9 +80,33 @@ public:
             meshes[i].Draw(shader);
     }
 
+    void DrawInstanced(Shader& shader, int instances)
+    {
+        shader.use();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instances);
+    }
+
+    // sets the uniform meshId to firstId + the index of each mesh before drawing it, for the id output of Render
+    void Draw(Shader& shader, unsigned int firstId)
+    {
+        shader.use();
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            shader.setUint("meshId", firstId + i);
+            meshes[i].Draw(shader);
+        }
+    }
+
+    // frees the GPU buffers of every mesh, the model can not be drawn afterwards
+    void release()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].release();
+    }
+
     // this function one only changes the data inside the self-defined class Model, data in aiScene is not changed.
     void wingTransform(float* coefficient, int length) {
-        float x_mm, z_calib_mm, z_calib_inch;
+        double x_mm, z_calib_mm, z_calib_inch;
         for (int i = 0; i < this->meshes.size(); i++) {
             for (int j = 0; j < this->meshes[i].vertices.size(); j++) {
                 V3f* position = &(this->meshes[i].vertices[j].Position);
@@ -75,16 +117,49 @@ public:
                     z_calib_mm = z_calib_mm + coefficient[a];
                 }
                 z_calib_inch = z_calib_mm /254;
-                position->z() = position->z() + z_calib_inch;
+                position->z() = (float)(position->z() + z_calib_inch);
+            }
+            this->meshes[i].updateVertices();
+        }
+        generation = nextGeneration();
+    }
+
+    // bends every vertex of the model by load G with wingCalib, z += offset * G / referenceG. all meshes go through the
+    // vectorized kernel at once, then the vertex buffers are updated in place and the aiScene follows.
+    void calibrateWing(float G) {
+        size_t n = 0;
+        for (auto& mesh : meshes) n += mesh.vertices.size();
+        std::vector<float> x(n), y(n), offsets(n);
+        size_t k = 0;
+        for (auto& mesh : meshes) {
+            for (auto& v : mesh.vertices) {
+                x[k] = v.Position.x();
+                y[k] = v.Position.y();
+                k++;
+            }
+        }
+        wingCalib.offsets(x.data(), y.data(), offsets.data(), n);
+        float scale = G / wingCalib.referenceG;
+        k = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            for (auto& v : meshes[i].vertices) v.Position.z() += offsets[k++] * scale;
+            meshes[i].updateVertices();
+            // a mesh used by several nodes is assigned the same values again, never bent twice
+            if (i < sourceMeshes.size()) {
+                for (unsigned int j = 0; j < sourceMeshes[i]->mNumVertices; j++)
+                    sourceMeshes[i]->mVertices[j].z = meshes[i].vertices[j].Position.z();
             }
-            this->meshes[i].setup();
         }
+        generation = nextGeneration();
     }
 
+    // merged copy of both aiScenes, owned by the caller (delete it when done). for drawing both models use a Scene instead,
+    // it shares their GPU geometry without copying anything.
     aiScene* combineModels(Model* model2, bool isOutput=false) {
         aiScene* output = NULL;
-        aiScene* output1 = new aiScene();
-        aiScene* output2 = new aiScene();
+        // CopyScene allocates the copies and MergeScenes deletes them again
+        aiScene* output1 = NULL;
+        aiScene* output2 = NULL;
         Assimp::SceneCombiner::CopyScene(&output1, pscene);
         Assimp::SceneCombiner::CopyScene(&output2, model2->pscene);
         std::vector<aiScene*>input;
@@ -99,6 +174,9 @@ public:
     }
 
 private:
+    // the aiMesh every entry of meshes was loaded from
+    std::vector<aiMesh*> sourceMeshes;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(std::string const& path)
     {
@@ -130,6 +208,7 @@ private:
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
             meshes.push_back(processMesh(mesh, scene));
+            sourceMeshes.push_back(mesh);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -156,10 +235,6 @@ private:
             vector.x() = mesh->mVertices[i].x;
             vector.y() = mesh->mVertices[i].y;
             vector.z() = mesh->mVertices[i].z;
-            if (wingCalibCoefLen) {
-                vector = wingTransform(vector);
-                mesh->mVertices[i].z = vector.z();
-            }
             vertex.Position = vector;
             // normals
             if (mesh->HasNormals())
@@ -232,31 +307,6 @@ private:
         return Mesh(vertices, indices, textures, diffuse);
     }
 
-    Eigen::Vector3f wingTransform(Eigen::Vector3f vec) {
-        float x_mm, z_calib_mm_front, z_calib_mm_back, z_calib_mm_total, z_calib_inch, y_front, y_back;
-        x_mm = vec.x() * 25.4;
-        z_calib_mm_front = calculatePolynomial(wingCalibCoefFront, wingCalibCoefLen, x_mm);
-        z_calib_mm_back = calculatePolynomial(wingCalibCoefBack, wingCalibCoefLen, x_mm);
-        float linePoseFront[] = { -0.5192, 243.9 };
-        float linePoseBack[] = { -2.907e-16, 6.746e-16, 1.491e-10, -4.031e-10, -0.000323, 3.6e-05, -31.02 };
-        y_front = calculatePolynomial(linePoseFront, 2, (vec.x() > 0 ? vec.x() : -vec.x()));
-        y_back = calculatePolynomial(linePoseBack, 7, vec.x());
-        float ratio = (y_front - vec.y()) / (y_front - y_back);
-        z_calib_mm_total = z_calib_mm_front * ratio + z_calib_mm_back * (1 - ratio);
-        z_calib_inch = z_calib_mm_total / 25.4;
-        vec.z() = vec.z() + z_calib_inch * (wingCalibG / 2.5);
-        return vec;
-    }
-
-    float calculatePolynomial(float* coef, int len, float x) {
-        float output = 0;
-        for (int a = 0; a < len; a++) {
-            output = output * x;
-            output = output + coef[a];
-        }
-        return output;
-    }
-
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
@@ -0,0 +1,47 @@
+#version 330 core
+#define MAX_VIEWS 16
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 48) out;
+
+in vec3 VertexPos[];
+
+out vec3 Pos;
+out float gl_ClipDistance[2];
+
+uniform mat4 model;
+uniform int viewCount;
+// right and top edge of each camera in layer NDC, what lies beyond belongs to no camera and is clipped
+uniform vec2 viewExtent[MAX_VIEWS];
+
+// perspective * view of each camera, squeezed into its corner of the layer when it is smaller than the layers
+layout (std140) uniform Views {
+    mat4 viewProjection[MAX_VIEWS];
+};
+
+// every triangle goes to the layer of each camera that can see it
+void main()
+{
+    for (int v = 0; v < viewCount; v++) {
+        mat4 m = viewProjection[v] * model;
+        vec4 p[3];
+        for (int i = 0; i < 3; i++) p[i] = m * vec4(VertexPos[i], 1.0);
+        // all three outside of the same clip plane
+        bvec3 left = bvec3(p[0].x < -p[0].w, p[1].x < -p[1].w, p[2].x < -p[2].w);
+        vec2 e = viewExtent[v];
+        bvec3 right = bvec3(p[0].x > e.x * p[0].w, p[1].x > e.x * p[1].w, p[2].x > e.x * p[2].w);
+        bvec3 bottom = bvec3(p[0].y < -p[0].w, p[1].y < -p[1].w, p[2].y < -p[2].w);
+        bvec3 top = bvec3(p[0].y > e.y * p[0].w, p[1].y > e.y * p[1].w, p[2].y > e.y * p[2].w);
+        bvec3 behind = bvec3(p[0].z < -p[0].w, p[1].z < -p[1].w, p[2].z < -p[2].w);
+        if (all(left) || all(right) || all(bottom) || all(top) || all(behind)) continue;
+        for (int i = 0; i < 3; i++) {
+            gl_Layer = v;
+            gl_PrimitiveID = gl_PrimitiveIDIn;
+            Pos = VertexPos[i];
+            gl_Position = p[i];
+            gl_ClipDistance[0] = e.x * p[i].w - p[i].x;
+            gl_ClipDistance[1] = e.y * p[i].w - p[i].y;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
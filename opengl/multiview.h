@@ -0,0 +1,308 @@
+#ifndef MULTIVIEW_H
+#define MULTIVIEW_H
+
+#include <glad/glad.h>
+#include "render.h"
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+struct MultiViewDesc {
+    // one layer per camera, at most MultiViewRender::MAX_VIEWS. sizes may differ, the layers take the largest
+    std::vector<Camera*> cameras;
+    Model* bodyModel = 0;
+    // undeformed wing, bent by setWingG() like Render does
+    Model* wingModel = 0;
+    ModelTransformDesc* tranDesc = 0;
+    bool isRenderGrayImage = false;
+    // the pos layers take 12 bytes per pixel and camera, they are only made when asked for
+    bool isRenderPos = false;
+};
+
+// the models at one pose seen by a whole camera rig in a single submission: every camera is a layer of array textures,
+// a geometry shader sends each triangle to the layers of the cameras that see it, with their matrices in a uniform buffer.
+// camera i fills the bottom-left getWidth(i) x getHeight(i) of layer i. no background, MSAA or distortion.
+class MultiViewRender {
+public:
+    static const int MAX_VIEWS = 16;
+
+    MultiViewRender(MultiViewDesc d) {
+        if (d.cameras.empty() || (!d.bodyModel && !d.wingModel)) {
+            printf("MultiViewDesc is incomplete, program exiting...\n");
+            exit(-1);
+        }
+        if ((int)d.cameras.size() > MAX_VIEWS) {
+            printf("at most %d cameras can be rendered at once, program exiting...\n", MAX_VIEWS);
+            exit(-1);
+        }
+        cameras = d.cameras;
+        bodyModel = d.bodyModel;
+        wingModel = d.wingModel;
+        isRenderGrayImage = d.isRenderGrayImage;
+        isRenderPos = d.isRenderPos;
+        if (d.tranDesc) setModelTransform(d.tranDesc);
+        for (Camera* c : cameras) {
+            width = std::max(width, c->getWidth());
+            height = std::max(height, c->getHeight());
+        }
+        int views = getViewCount();
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        colorTexture = createArray(isRenderGrayImage ? GL_R8 : GL_RGB8, isRenderGrayImage ? GL_RED : GL_RGB, GL_UNSIGNED_BYTE, views);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTexture, 0);
+        if (isRenderPos) {
+            posTexture = createArray(GL_RGB32F, GL_RGB, GL_FLOAT, views);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, posTexture, 0);
+        }
+        // a layered framebuffer needs layered attachments only, so depth is an array texture too
+        depthTexture = createArray(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, views);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+        const GLenum buffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(isRenderPos ? 2 : 1, buffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: multi view framebuffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(1, &viewUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, viewUBO);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_VIEWS * 16 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // the wing calibration is generated into the vertex shader, see Render::updateWingPrograms
+        WingCalibration calib = wingModel ? wingModel->wingCalib : WingCalibration();
+        std::string vertexCode, geometryCode, colorCode, grayCode;
+        if (!Shader::readFile("multiview.vs", vertexCode) || !Shader::readFile("multiview.gs", geometryCode) ||
+            !Shader::readFile("objectShader.fs", colorCode) || !Shader::readFile("objectShader_gray.fs", grayCode))
+            printf("can not read the multiview shader files\n");
+        vertexCode = calib.shaderSource(vertexCode, false);
+        shader = ProgramCache::instance().getFromSource(vertexCode, isRenderGrayImage ? grayCode : colorCode, geometryCode,
+            "multiview.vs", isRenderGrayImage ? "objectShader_gray.fs" : "objectShader.fs");
+        glUniformBlockBinding(shader->ID, glGetUniformBlockIndex(shader->ID, "Views"), VIEW_BINDING);
+    }
+
+    ~MultiViewRender() {
+        unsigned int textures[] = { colorTexture, posTexture, depthTexture, referenceTexture, rowSumTexture, scoreTexture };
+        unsigned int fbos[] = { fbo, rowSumFBO, scoreFBO };
+        for (unsigned int t : textures) if (t) glDeleteTextures(1, &t);
+        for (unsigned int f : fbos) if (f) glDeleteFramebuffers(1, &f);
+        if (viewUBO) glDeleteBuffers(1, &viewUBO);
+        if (emptyVAO) glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    void setModelTransform(ModelTransformDesc* d) { modelMatrix = calculateModelMatrix(*d); }
+    void setWingG(float G) { wingG = G; }
+    float getWingG() { return wingG; }
+
+    int getViewCount() { return (int)cameras.size(); }
+    // size of the layers, the largest camera
+    int getLayerWidth() { return width; }
+    int getLayerHeight() { return height; }
+    int getWidth(int view) { return cameras[view]->getWidth(); }
+    int getHeight(int view) { return cameras[view]->getHeight(); }
+    int getChannels() { return isRenderGrayImage ? 1 : 3; }
+    unsigned int getColorTexture() { return colorTexture; }
+    unsigned int getPosTexture() { return posTexture; }
+
+    // the cameras' current view matrices and intrinsics are used, so a moving rig needs nothing but the cameras updated
+    void draw() {
+        int views = getViewCount();
+        std::vector<float> matrices((size_t)views * 16), extents((size_t)views * 2);
+        for (int v = 0; v < views; v++) {
+            Camera* c = cameras[v];
+            float sx = (float)c->getWidth() / width, sy = (float)c->getHeight() / height;
+            // maps the camera's NDC onto its bottom-left corner of the layer
+            M4f squeeze = M4f::Identity();
+            squeeze(0, 0) = sx;
+            squeeze(0, 3) = sx - 1;
+            squeeze(1, 1) = sy;
+            squeeze(1, 3) = sy - 1;
+            M4f m = squeeze * c->getPerspectiveMatrix() * c->getViewMatrix();
+            memcpy(&matrices[(size_t)v * 16], m.data(), 16 * sizeof(float));
+            extents[v * 2] = 2 * sx - 1;
+            extents[v * 2 + 1] = 2 * sy - 1;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, viewUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, matrices.size() * sizeof(float), matrices.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, VIEW_BINDING, viewUBO);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+        glDisable(GL_SCISSOR_TEST);
+        glEnable(GL_DEPTH_TEST);
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (isRenderPos) {
+            const GLfloat far[4] = { 1e6f, 1e6f, 1e6f, 1e6f };
+            glClearBufferfv(GL_COLOR, 1, far);
+        }
+        shader->use();
+        shader->setMat4("model", modelMatrix);
+        shader->setInt("viewCount", views);
+        shader->setFloat("G", wingG);
+        glUniform2fv(glGetUniformLocation(shader->ID, "viewExtent"), views, extents.data());
+        glEnable(GL_CLIP_DISTANCE0);
+        glEnable(GL_CLIP_DISTANCE1);
+        if (bodyModel) {
+            shader->setBool("isDeformed", false);
+            bodyModel->Draw(*shader);
+        }
+        if (wingModel) {
+            shader->setBool("isDeformed", true);
+            wingModel->Draw(*shader);
+        }
+        glDisable(GL_CLIP_DISTANCE0);
+        glDisable(GL_CLIP_DISTANCE1);
+    }
+
+    // every layer with one call: getViewCount() images of getLayerWidth() x getLayerHeight() x getChannels() bytes,
+    // rows bottom-up. view i is the bottom-left getWidth(i) x getHeight(i) of image i
+    void readImages(unsigned char* dst) {
+        readArray(colorTexture, isRenderGrayImage ? GL_RED : GL_RGB, GL_UNSIGNED_BYTE, dst);
+    }
+
+    // pos of every layer laid out like readImages(), 3 floats per pixel. needs MultiViewDesc::isRenderPos
+    bool readPos(float* dst) {
+        if (!posTexture) {
+            printf("pos is only rendered with MultiViewDesc::isRenderPos\n");
+            return false;
+        }
+        readArray(posTexture, GL_RGB, GL_FLOAT, dst);
+        return true;
+    }
+
+    // gray reference image of a view, getWidth(view) x getHeight(view) bytes, rows bottom-up
+    void setReferenceImage(int view, const unsigned char* gray) {
+        if (!referenceTexture) createReference();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, referenceTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, view, getWidth(view), getHeight(view), 1, GL_RED, GL_UNSIGNED_BYTE, gray);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // mean squared gray difference (gray levels) of each view of the last draw against its reference image, reduced on the
+    // GPU by rows and then by view, so only getViewCount() floats are read back
+    void scoreViews(float* scores) {
+        int views = getViewCount();
+        if (!referenceTexture) createReference();
+        if (!rowSumFBO) {
+            rowSumTexture = createTarget(rowSumFBO, height, views);
+            scoreTexture = createTarget(scoreFBO, 1, views);
+            diffShader = ProgramCache::instance().get("fullscreen.vs", "viewDiff.fs");
+            sumShader = ProgramCache::instance().get("fullscreen.vs", "viewSum.fs");
+            glGenVertexArrays(1, &emptyVAO);
+        }
+        std::vector<int> sizes(views * 2);
+        for (int v = 0; v < views; v++) {
+            sizes[v * 2] = getWidth(v);
+            sizes[v * 2 + 1] = getHeight(v);
+        }
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(emptyVAO);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, rowSumFBO);
+        glViewport(0, 0, height, views);
+        diffShader->use();
+        diffShader->setInt("colorTexture", 0);
+        diffShader->setInt("referenceTexture", 1);
+        diffShader->setBool("isGray", isRenderGrayImage);
+        glUniform2iv(glGetUniformLocation(diffShader->ID, "viewSize"), views, sizes.data());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, colorTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, referenceTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, scoreFBO);
+        glViewport(0, 0, 1, views);
+        sumShader->use();
+        sumShader->setInt("rowSums", 0);
+        glUniform2iv(glGetUniformLocation(sumShader->ID, "viewSize"), views, sizes.data());
+        glBindTexture(GL_TEXTURE_2D, rowSumTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, 1, views, GL_RED, GL_FLOAT, scores);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+
+private:
+    static const int VIEW_BINDING = 0;
+
+    std::vector<Camera*> cameras;
+    Model* bodyModel = NULL;
+    Model* wingModel = NULL;
+    M4f modelMatrix = M4f::Identity();
+    float wingG = 0;
+    bool isRenderGrayImage = false;
+    bool isRenderPos = false;
+    int width = 0;
+    int height = 0;
+    Shader* shader = NULL;
+    unsigned int fbo = 0;
+    unsigned int colorTexture = 0;
+    unsigned int posTexture = 0;
+    unsigned int depthTexture = 0;
+    unsigned int viewUBO = 0;
+    // scoring
+    unsigned int referenceTexture = 0;
+    unsigned int rowSumTexture = 0;             // R32F, a row of row sums per view
+    unsigned int rowSumFBO = 0;
+    unsigned int scoreTexture = 0;              // R32F, 1 x views
+    unsigned int scoreFBO = 0;
+    unsigned int emptyVAO = 0;
+    Shader* diffShader = NULL;
+    Shader* sumShader = NULL;
+
+    unsigned int createArray(GLenum internalFormat, GLenum format, GLenum type, int layers, const void* data = NULL) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, layers, 0, format, type, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    // views without a reference image are scored against black
+    void createReference() {
+        std::vector<unsigned char> zero((size_t)width * height * getViewCount(), 0);
+        referenceTexture = createArray(GL_R8, GL_RED, GL_UNSIGNED_BYTE, getViewCount(), zero.data());
+    }
+
+    unsigned int createTarget(unsigned int& targetFBO, int w, int h) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &targetFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        return texture;
+    }
+
+    void readArray(unsigned int texture, GLenum format, GLenum type, void* dst) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, format, type, dst);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+// model space, transformed per view by multiview.gs
+out vec3 VertexPos;
+
+uniform float G;
+uniform bool isDeformed;
+
+// wingOffset() and WING_REFERENCE_G are inserted by WingCalibration::shaderSource(), see wingShader.vs
+
+void main()
+{
+    vec3 p = aPos;
+    if (isDeformed) p.z = p.z + wingOffset(aPos) * (G / WING_REFERENCE_G);
+    VertexPos = p;
+}
@@ -4,11 +4,15 @@ in vec3 Pos;
 
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec3 Pos1;
+// mesh id and triangle, read only when Render has its id output on
+layout (location = 2) out uvec2 Id;
 
 uniform vec4 color;
+uniform uint meshId;
 
 void main()
 {    
     FragColor = color;
     Pos1 = Pos;
+    Id = uvec2(meshId, uint(gl_PrimitiveID));
 }
\ No newline at end of file
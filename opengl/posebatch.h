@@ -0,0 +1,169 @@
+#ifndef POSEBATCH_H
+#define POSEBATCH_H
+
+#include <Eigen\Dense>
+#include <vector>
+#include <cmath>
+typedef Eigen::Vector3f V3f;
+typedef Eigen::Matrix4f M4f;
+
+// view matrices (world -> camera) of many cameras stored as structure of arrays, one array per element of R and t.
+// every conversion is a plain loop over independent poses so the compiler can vectorise it.
+//
+// orientations are given for the camera -> world rotation Rc = R^T:
+//   quaternion (w, x, y, z)
+//   euler (rx, ry, rz) with Rc = Rx(rx) * Ry(ry) * Rz(rz), the same convention as ModelTransformDesc
+// camera position is the closed form inverse -R^T * t, no linear solve needed.
+class PoseBatch {
+public:
+    // r[3 * row + col], t[row]
+    std::vector<float> r[9];
+    std::vector<float> t[3];
+
+    PoseBatch(int n = 0) { resize(n); }
+
+    int size() const { return (int)t[0].size(); }
+
+    void resize(int n) {
+        for (int k = 0; k < 9; k++) r[k].resize(n);
+        for (int k = 0; k < 3; k++) t[k].resize(n);
+    }
+
+    void setViewMatrix(int i, const M4f& m) {
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++)
+                r[3 * row + col][i] = m(row, col);
+            t[row][i] = m(row, 3);
+        }
+    }
+
+    M4f viewMatrix(int i) const {
+        M4f m = M4f::Identity();
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++)
+                m(row, col) = r[3 * row + col][i];
+            m(row, 3) = t[row][i];
+        }
+        return m;
+    }
+
+    void fromViewMatrices(const M4f* views, int n) {
+        resize(n);
+        for (int i = 0; i < n; i++) setViewMatrix(i, views[i]);
+    }
+
+    void toViewMatrices(M4f* views) const {
+        for (int i = 0; i < size(); i++) views[i] = viewMatrix(i);
+    }
+
+    void getPositions(float* px, float* py, float* pz) const {
+        const float* r00 = r[0].data(); const float* r01 = r[1].data(); const float* r02 = r[2].data();
+        const float* r10 = r[3].data(); const float* r11 = r[4].data(); const float* r12 = r[5].data();
+        const float* r20 = r[6].data(); const float* r21 = r[7].data(); const float* r22 = r[8].data();
+        const float* tx = t[0].data(); const float* ty = t[1].data(); const float* tz = t[2].data();
+        int n = size();
+        for (int i = 0; i < n; i++) {
+            px[i] = -(r00[i] * tx[i] + r10[i] * ty[i] + r20[i] * tz[i]);
+            py[i] = -(r01[i] * tx[i] + r11[i] * ty[i] + r21[i] * tz[i]);
+            pz[i] = -(r02[i] * tx[i] + r12[i] * ty[i] + r22[i] * tz[i]);
+        }
+    }
+
+    void fromPositionQuaternion(const float* px, const float* py, const float* pz,
+        const float* qw, const float* qx, const float* qy, const float* qz, int n) {
+        resize(n);
+        float* rr[9];
+        for (int k = 0; k < 9; k++) rr[k] = r[k].data();
+        for (int i = 0; i < n; i++) {
+            float inv = 1.0f / std::sqrt(qw[i] * qw[i] + qx[i] * qx[i] + qy[i] * qy[i] + qz[i] * qz[i]);
+            float w = qw[i] * inv, x = qx[i] * inv, y = qy[i] * inv, z = qz[i] * inv;
+            // R = Rc^T, written out transposed
+            rr[0][i] = 1 - 2 * (y * y + z * z); rr[1][i] = 2 * (x * y + w * z);     rr[2][i] = 2 * (x * z - w * y);
+            rr[3][i] = 2 * (x * y - w * z);     rr[4][i] = 1 - 2 * (x * x + z * z); rr[5][i] = 2 * (y * z + w * x);
+            rr[6][i] = 2 * (x * z + w * y);     rr[7][i] = 2 * (y * z - w * x);     rr[8][i] = 1 - 2 * (x * x + y * y);
+        }
+        setTranslationsFromPositions(px, py, pz);
+    }
+
+    void toQuaternions(float* qw, float* qx, float* qy, float* qz) const {
+        const float* r00 = r[0].data(); const float* r01 = r[1].data(); const float* r02 = r[2].data();
+        const float* r10 = r[3].data(); const float* r11 = r[4].data(); const float* r12 = r[5].data();
+        const float* r20 = r[6].data(); const float* r21 = r[7].data(); const float* r22 = r[8].data();
+        int n = size();
+        for (int i = 0; i < n; i++) {
+            // Shepperd: the largest of w, x, y, z comes from the diagonal, where its square is at least 1/4, the others
+            // from sums and differences of the off diagonal elements of Rc = R^T. near 180 degrees w is about 0 and the
+            // differences are noise, so the signs must not come from them alone
+            float t = r00[i] + r11[i] + r22[i];
+            float w, x, y, z;
+            if (t >= r00[i] && t >= r11[i] && t >= r22[i]) {
+                w = 0.5f * std::sqrt(1 + t);
+                float s = 0.25f / w;
+                x = (r12[i] - r21[i]) * s; y = (r20[i] - r02[i]) * s; z = (r01[i] - r10[i]) * s;
+            }
+            else if (r00[i] >= r11[i] && r00[i] >= r22[i]) {
+                x = 0.5f * std::sqrt(1 + r00[i] - r11[i] - r22[i]);
+                float s = 0.25f / x;
+                w = (r12[i] - r21[i]) * s; y = (r01[i] + r10[i]) * s; z = (r02[i] + r20[i]) * s;
+            }
+            else if (r11[i] >= r22[i]) {
+                y = 0.5f * std::sqrt(1 - r00[i] + r11[i] - r22[i]);
+                float s = 0.25f / y;
+                w = (r20[i] - r02[i]) * s; x = (r01[i] + r10[i]) * s; z = (r12[i] + r21[i]) * s;
+            }
+            else {
+                z = 0.5f * std::sqrt(1 - r00[i] - r11[i] + r22[i]);
+                float s = 0.25f / z;
+                w = (r01[i] - r10[i]) * s; x = (r02[i] + r20[i]) * s; y = (r12[i] + r21[i]) * s;
+            }
+            // q and -q are the same rotation, w >= 0 as before
+            float sign = w < 0 ? -1.0f : 1.0f;
+            qw[i] = sign * w; qx[i] = sign * x; qy[i] = sign * y; qz[i] = sign * z;
+        }
+    }
+
+    void fromPositionEuler(const float* px, const float* py, const float* pz,
+        const float* rx, const float* ry, const float* rz, int n) {
+        resize(n);
+        float* rr[9];
+        for (int k = 0; k < 9; k++) rr[k] = r[k].data();
+        for (int i = 0; i < n; i++) {
+            float cx = std::cos(rx[i]), sx = std::sin(rx[i]);
+            float cy = std::cos(ry[i]), sy = std::sin(ry[i]);
+            float cz = std::cos(rz[i]), sz = std::sin(rz[i]);
+            // Rc = Rx * Ry * Rz, stored transposed
+            rr[0][i] = cy * cz;  rr[3][i] = -cy * sz; rr[6][i] = sy;
+            rr[1][i] = cx * sz + sx * sy * cz; rr[4][i] = cx * cz - sx * sy * sz; rr[7][i] = -sx * cy;
+            rr[2][i] = sx * sz - cx * sy * cz; rr[5][i] = sx * cz + cx * sy * sz; rr[8][i] = cx * cy;
+        }
+        setTranslationsFromPositions(px, py, pz);
+    }
+
+    void toEuler(float* rx, float* ry, float* rz) const {
+        const float* rc01 = r[3].data(); const float* rc02 = r[6].data(); const float* rc12 = r[7].data();
+        const float* rc00 = r[0].data(); const float* rc22 = r[8].data();
+        int n = size();
+        for (int i = 0; i < n; i++) {
+            ry[i] = std::asin(std::fmin(1.0f, std::fmax(-1.0f, rc02[i])));
+            rx[i] = std::atan2(-rc12[i], rc22[i]);
+            rz[i] = std::atan2(-rc01[i], rc00[i]);
+        }
+    }
+
+private:
+    // t = -R * p, R already filled in
+    void setTranslationsFromPositions(const float* px, const float* py, const float* pz) {
+        const float* r00 = r[0].data(); const float* r01 = r[1].data(); const float* r02 = r[2].data();
+        const float* r10 = r[3].data(); const float* r11 = r[4].data(); const float* r12 = r[5].data();
+        const float* r20 = r[6].data(); const float* r21 = r[7].data(); const float* r22 = r[8].data();
+        float* tx = t[0].data(); float* ty = t[1].data(); float* tz = t[2].data();
+        int n = size();
+        for (int i = 0; i < n; i++) {
+            tx[i] = -(r00[i] * px[i] + r01[i] * py[i] + r02[i] * pz[i]);
+            ty[i] = -(r10[i] * px[i] + r11[i] * py[i] + r12[i] * pz[i]);
+            tz[i] = -(r20[i] * px[i] + r21[i] * py[i] + r22[i] * pz[i]);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef POSEJACOBIAN_H
+#define POSEJACOBIAN_H
+
+#include <glad/glad.h>
+#include "render.h"
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+struct PoseJacobianDesc {
+    Camera* camera = 0;
+    Model* bodyModel = 0;
+    // undeformed wing, bent by G like Render::setWingG()
+    Model* wingModel = 0;
+    // finite difference steps of tx, ty, tz (model units), rx, ry, rz (radians) and G. a step should move the silhouette
+    // by about a pixel: much smaller and the differences vanish in rasterisation, much larger and they stop being local
+    float delta[7] = { 1.0f, 1.0f, 1.0f, 0.002f, 0.002f, 0.002f, 0.05f };
+};
+
+// sums over the pixels of the gray residual r = rendered - reference and its derivatives J by tx, ty, tz, rx, ry, rz, G
+struct PoseJacobianResult {
+    float JtJ[7][7];
+    float Jtr[7];
+    float cost;                 // sum of r^2 at the current pose, in gray levels
+    int pixels;                 // pixels where any derivative is non zero
+};
+
+// central differences of the rendered gray image for Gauss-Newton pose refinement. the current pose and the 14 poses with
+// one parameter raised or lowered are drawn by one instanced draw per model into the layers of an array texture, the
+// geometry shader routes each instance to its layer. two reduction passes then sum J^T J, J^T r and the cost on the GPU,
+// so a step reads back 21 vec4s instead of 15 images. the output is the camera's full frame, no MSAA, background or distortion.
+class PoseJacobian {
+public:
+    static const int PARAMETERS = 7;
+    static const int VARIANTS = 1 + 2 * PARAMETERS;
+
+    PoseJacobian(PoseJacobianDesc d) {
+        if (!d.camera || (!d.bodyModel && !d.wingModel)) {
+            printf("PoseJacobianDesc is incomplete, program exiting...\n");
+            exit(-1);
+        }
+        camera = d.camera;
+        bodyModel = d.bodyModel;
+        wingModel = d.wingModel;
+        setDeltas(d.delta);
+        width = camera->getWidth();
+        height = camera->getHeight();
+
+        glGenTextures(1, &variantTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, variantTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, width, height, VARIANTS, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        setNearest(GL_TEXTURE_2D_ARRAY);
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, width, height, VARIANTS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        setNearest(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glGenFramebuffers(1, &variantFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, variantFBO);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, variantTexture, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+        checkFramebuffer();
+
+        // the reference starts black until setReferenceImage()
+        std::vector<unsigned char> zero((size_t)width * height, 0);
+        glGenTextures(1, &referenceTexture);
+        glBindTexture(GL_TEXTURE_2D, referenceTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, zero.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        setNearest(GL_TEXTURE_2D);
+
+        createSums(rowFBO, rowTextures, height);
+        createSums(sumFBO, sumTextures, 1);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glGenVertexArrays(1, &emptyVAO);
+
+        // the wing calibration is generated into the vertex shader, see Render::updateWingPrograms
+        WingCalibration calib = wingModel ? wingModel->wingCalib : WingCalibration();
+        std::string vertexCode, geometryCode, fragmentCode;
+        if (!Shader::readFile("jacobian.vs", vertexCode) || !Shader::readFile("jacobian.gs", geometryCode) ||
+            !Shader::readFile("objectShader_gray.fs", fragmentCode))
+            printf("can not read the jacobian shader files\n");
+        ProgramCache& programs = ProgramCache::instance();
+        variantShader = programs.getFromSource(calib.shaderSource(vertexCode, false), fragmentCode, geometryCode,
+            "jacobian.vs", "objectShader_gray.fs");
+        rowShader = programs.get("fullscreen.vs", "jacobianRows.fs");
+        sumShader = programs.get("fullscreen.vs", "jacobianSum.fs");
+    }
+
+    ~PoseJacobian() {
+        unsigned int textures[] = { variantTexture, depthTexture, referenceTexture,
+            rowTextures[0], rowTextures[1], rowTextures[2], sumTextures[0], sumTextures[1], sumTextures[2] };
+        unsigned int fbos[] = { variantFBO, rowFBO, sumFBO };
+        for (unsigned int t : textures) if (t) glDeleteTextures(1, &t);
+        for (unsigned int f : fbos) if (f) glDeleteFramebuffers(1, &f);
+        if (emptyVAO) glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    void setDeltas(const float* d) {
+        for (int k = 0; k < PARAMETERS; k++) delta[k] = d[k];
+    }
+    const float* getDeltas() { return delta; }
+
+    // camera sized gray image, rows bottom-up like the outputs of Render
+    void setReferenceImage(const unsigned char* gray) {
+        glBindTexture(GL_TEXTURE_2D, referenceTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, gray);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // renders the variants around pose and G and sums the normal equations. the camera's current matrices are used.
+    // the framebuffer binding and viewport are restored
+    void compute(const ModelTransformDesc& pose, float G, PoseJacobianResult& result) {
+        GLint previousFBO = 0, viewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        std::vector<float> models((size_t)VARIANTS * 16), gs(VARIANTS);
+        for (int v = 0; v < VARIANTS; v++) {
+            ModelTransformDesc d = pose;
+            float g = G;
+            if (v > 0) {
+                int k = (v - 1) / 2;
+                float step = (v - 1) % 2 == 0 ? delta[k] : -delta[k];
+                float* parameters[PARAMETERS] = { &d.tx, &d.ty, &d.tz, &d.rx, &d.ry, &d.rz, &g };
+                *parameters[k] += step;
+            }
+            M4f m = calculateModelMatrix(d);
+            memcpy(&models[(size_t)v * 16], m.data(), 16 * sizeof(float));
+            gs[v] = g;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, variantFBO);
+        glViewport(0, 0, width, height);
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        variantShader->use();
+        variantShader->setMat4("viewProjection", M4f(camera->getPerspectiveMatrix() * camera->getViewMatrix()));
+        glUniformMatrix4fv(glGetUniformLocation(variantShader->ID, "variantModel"), VARIANTS, GL_FALSE, models.data());
+        glUniform1fv(glGetUniformLocation(variantShader->ID, "variantG"), VARIANTS, gs.data());
+        if (bodyModel) {
+            variantShader->setBool("isDeformed", false);
+            bodyModel->DrawInstanced(*variantShader, VARIANTS);
+        }
+        if (wingModel) {
+            variantShader->setBool("isDeformed", true);
+            wingModel->DrawInstanced(*variantShader, VARIANTS);
+        }
+
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(emptyVAO);
+        glBindFramebuffer(GL_FRAMEBUFFER, rowFBO);
+        glViewport(0, 0, height, PARAMETERS);
+        rowShader->use();
+        rowShader->setInt("variantTexture", 0);
+        rowShader->setInt("referenceTexture", 1);
+        glUniform1fv(glGetUniformLocation(rowShader->ID, "delta"), PARAMETERS, delta);
+        glUniform2i(glGetUniformLocation(rowShader->ID, "size"), width, height);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, variantTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, referenceTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sumFBO);
+        glViewport(0, 0, 1, PARAMETERS);
+        sumShader->use();
+        sumShader->setInt("rowCount", height);
+        for (int t = 0; t < 3; t++) {
+            sumShader->setInt("rows" + std::to_string(t), t);
+            glActiveTexture(GL_TEXTURE0 + t);
+            glBindTexture(GL_TEXTURE_2D, rowTextures[t]);
+        }
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        for (int t = 2; t >= 0; t--) {
+            glActiveTexture(GL_TEXTURE0 + t);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+
+        // a vec4 per parameter and output: JtJ[i][0..3], JtJ[i][4..6] and Jtr[i], cost and pixels
+        float sums[3][PARAMETERS][4];
+        for (int t = 0; t < 3; t++) {
+            glReadBuffer(GL_COLOR_ATTACHMENT0 + t);
+            glReadPixels(0, 0, 1, PARAMETERS, GL_RGBA, GL_FLOAT, sums[t]);
+        }
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        for (int i = 0; i < PARAMETERS; i++) {
+            for (int k = 0; k < 4; k++) result.JtJ[i][k] = sums[0][i][k];
+            for (int k = 0; k < 3; k++) result.JtJ[i][4 + k] = sums[1][i][k];
+            result.Jtr[i] = sums[1][i][3];
+        }
+        result.cost = sums[2][0][0];
+        result.pixels = (int)(sums[2][0][1] + 0.5f);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // solves (J^T J + damping * diag(J^T J)) x = -J^T r and adds x to pose and G. parameters no pixel depends on stay put.
+    // false when the system is singular
+    static bool gaussNewtonStep(const PoseJacobianResult& r, float damping, ModelTransformDesc& pose, float& G) {
+        Eigen::Matrix<float, PARAMETERS, PARAMETERS> A;
+        Eigen::Matrix<float, PARAMETERS, 1> b;
+        for (int i = 0; i < PARAMETERS; i++) {
+            for (int k = 0; k < PARAMETERS; k++) A(i, k) = r.JtJ[i][k];
+            b(i) = -r.Jtr[i];
+            A(i, i) = A(i, i) > 0 ? A(i, i) * (1 + damping) : 1;
+        }
+        Eigen::LDLT<Eigen::Matrix<float, PARAMETERS, PARAMETERS>> ldlt(A);
+        if (ldlt.info() != Eigen::Success) return false;
+        Eigen::Matrix<float, PARAMETERS, 1> x = ldlt.solve(b);
+        if (!x.allFinite()) return false;
+        float* parameters[PARAMETERS] = { &pose.tx, &pose.ty, &pose.tz, &pose.rx, &pose.ry, &pose.rz, &G };
+        for (int k = 0; k < PARAMETERS; k++) *parameters[k] += x(k);
+        return true;
+    }
+
+    // R8 array, layer 0 the current pose, layers 1 + 2k and 2 + 2k parameter k raised and lowered
+    unsigned int getVariantTexture() { return variantTexture; }
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+
+private:
+    Camera* camera;
+    Model* bodyModel;
+    Model* wingModel;
+    float delta[PARAMETERS];
+    int width;
+    int height;
+    unsigned int variantTexture = 0;
+    unsigned int depthTexture = 0;
+    unsigned int variantFBO = 0;
+    unsigned int referenceTexture = 0;
+    unsigned int rowTextures[3] = { 0, 0, 0 };      // RGBA32F, height x parameters
+    unsigned int rowFBO = 0;
+    unsigned int sumTextures[3] = { 0, 0, 0 };      // RGBA32F, 1 x parameters
+    unsigned int sumFBO = 0;
+    unsigned int emptyVAO = 0;
+    Shader* variantShader = NULL;
+    Shader* rowShader = NULL;
+    Shader* sumShader = NULL;
+
+    static void setNearest(GLenum target) {
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    static void checkFramebuffer() {
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: jacobian framebuffer is not complete!" << std::endl;
+    }
+
+    // three RGBA32F targets of w x PARAMETERS on one framebuffer, the outputs of jacobianRows.fs and jacobianSum.fs
+    void createSums(unsigned int& fbo, unsigned int* textures, int w) {
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        for (int t = 0; t < 3; t++) {
+            glGenTextures(1, &textures[t]);
+            glBindTexture(GL_TEXTURE_2D, textures[t]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, PARAMETERS, 0, GL_RGBA, GL_FLOAT, NULL);
+            setNearest(GL_TEXTURE_2D);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + t, GL_TEXTURE_2D, textures[t], 0);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        const GLenum buffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, buffers);
+        checkFramebuffer();
+    }
+};
+
+#endif
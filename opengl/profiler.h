@@ -0,0 +1,195 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+enum RenderStage {
+    STAGE_BACKGROUND,
+    STAGE_BODY,
+    STAGE_WING,
+    STAGE_SCENE,
+    STAGE_MSAA_BLIT,
+    STAGE_DISTORTION,
+    STAGE_READBACK,
+    STAGE_ENCODE,
+    STAGE_DISTANCE_FIELD,
+    STAGE_COUNT
+};
+
+static const char* renderStageNames[STAGE_COUNT] = { "background", "body", "wing", "scene", "msaa_blit", "distortion", "readback", "encode", "distance_field" };
+
+// all values in milliseconds
+struct StageStats {
+    long long count = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// log scale histogram, every bucket is 2% wider than the previous one, from 1 microsecond to about a minute.
+// memory stays constant no matter how long the process runs.
+class StageHistogram {
+public:
+    static const int BUCKETS = 920;
+
+    StageHistogram(): buckets(BUCKETS, 0) {}
+
+    void add(double ms) {
+        int b = ms <= MIN_MS ? 0 : (int)(std::log(ms / MIN_MS) / std::log(GROWTH)) + 1;
+        if (b >= BUCKETS) b = BUCKETS - 1;
+        buckets[b]++;
+        count++;
+        sum += ms;
+        if (ms > max) max = ms;
+    }
+
+    StageStats getStats() const {
+        StageStats s;
+        s.count = count;
+        if (!count) return s;
+        s.mean = sum / count;
+        s.max = max;
+        s.p50 = percentile(0.50);
+        s.p95 = percentile(0.95);
+        s.p99 = percentile(0.99);
+        return s;
+    }
+
+    void reset() {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        count = 0;
+        sum = 0;
+        max = 0;
+    }
+
+private:
+    static constexpr double MIN_MS = 1e-3;
+    static constexpr double GROWTH = 1.02;
+    std::vector<long long> buckets;
+    long long count = 0;
+    double sum = 0;
+    double max = 0;
+
+    // upper edge of the bucket holding the requested rank, never more than the largest sample
+    double percentile(double q) const {
+        long long rank = (long long)std::ceil(q * count);
+        long long seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += buckets[b];
+            if (seen >= rank) return std::fmin(max, MIN_MS * std::pow(GROWTH, b));
+        }
+        return max;
+    }
+};
+
+// times every stage of Render on the CPU with a steady clock and on the GPU with GL_TIME_ELAPSED queries.
+// query results are collected lazily once they are available, so profiling never stalls the pipeline.
+// one profiler can be shared by several Render objects on the same context.
+class RenderProfiler {
+public:
+    bool isGpuTimingEnable = true;
+
+    ~RenderProfiler() {
+        for (auto& p : pending) freeQueries.push_back(p.query);
+        if (!freeQueries.empty()) glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+    }
+
+    void begin(RenderStage stage) {
+        cpuStart[stage] = std::chrono::steady_clock::now();
+        // GL_TIME_ELAPSED queries can not overlap, encode is pure CPU work anyway
+        if (!isGpuTimingEnable || stage == STAGE_ENCODE || gpuActive) return;
+        if (freeQueries.empty()) {
+            unsigned int q;
+            glGenQueries(1, &q);
+            freeQueries.push_back(q);
+        }
+        activeQuery = freeQueries.back();
+        freeQueries.pop_back();
+        glBeginQuery(GL_TIME_ELAPSED, activeQuery);
+        gpuActive = true;
+        gpuStage = stage;
+    }
+
+    void end(RenderStage stage) {
+        if (gpuActive && gpuStage == stage) {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending.push_back({ stage, activeQuery });
+            gpuActive = false;
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - cpuStart[stage];
+        cpu[stage].add(elapsed.count());
+        collect(false);
+    }
+
+    StageStats getCpuStats(RenderStage stage) {
+        return cpu[stage].getStats();
+    }
+
+    // waits for every query still in flight
+    StageStats getGpuStats(RenderStage stage) {
+        collect(true);
+        return gpu[stage].getStats();
+    }
+
+    void reset() {
+        collect(true);
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            cpu[i].reset();
+            gpu[i].reset();
+        }
+    }
+
+    void dump(FILE* out = stdout) {
+        fprintf(out, "%-12s %8s %10s %10s %10s %10s | %10s %10s %10s %10s   (ms)\n",
+            "stage", "count", "cpu p50", "cpu p95", "cpu p99", "cpu max", "gpu p50", "gpu p95", "gpu p99", "gpu max");
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            StageStats c = getCpuStats((RenderStage)i);
+            StageStats g = getGpuStats((RenderStage)i);
+            if (!c.count) continue;
+            fprintf(out, "%-12s %8lld %10.3f %10.3f %10.3f %10.3f | %10.3f %10.3f %10.3f %10.3f\n", renderStageNames[i],
+                c.count, c.p50, c.p95, c.p99, c.max, g.p50, g.p95, g.p99, g.max);
+        }
+    }
+
+private:
+    struct PendingQuery {
+        RenderStage stage;
+        unsigned int query;
+    };
+    StageHistogram cpu[STAGE_COUNT];
+    StageHistogram gpu[STAGE_COUNT];
+    std::chrono::steady_clock::time_point cpuStart[STAGE_COUNT];
+    std::deque<PendingQuery> pending;
+    std::vector<unsigned int> freeQueries;
+    unsigned int activeQuery = 0;
+    RenderStage gpuStage = STAGE_COUNT;
+    bool gpuActive = false;
+
+    // queries finish in submission order, so stop at the first one that is not ready
+    void collect(bool wait) {
+        while (!pending.empty()) {
+            PendingQuery p = pending.front();
+            GLint available = 0;
+            if (!wait) {
+                glGetQueryObjectiv(p.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) return;
+            }
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(p.query, GL_QUERY_RESULT, &ns);
+            gpu[p.stage].add(ns * 1e-6);
+            freeQueries.push_back(p.query);
+            pending.pop_front();
+        }
+    }
+};
+
+#endif
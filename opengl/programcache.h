@@ -0,0 +1,241 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "shader.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// GL_ARB_get_program_binary (core in 4.1) is not part of the 3.3 loader, its entry points are looked up at runtime
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRY* PFNRMGETPROGRAMBINARY)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRY* PFNRMPROGRAMBINARY)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRY* PFNRMPROGRAMPARAMETERI)(GLuint program, GLenum pname, GLint value);
+
+// linked programs shared by source: asking twice for the same sources returns the same Shader, whichever files they came from.
+// with a cache directory the linked binaries are also kept on disk, keyed by the sources and the driver, so later processes
+// skip compiling and linking. a binary the driver rejects (driver update, other GPU) is rebuilt from source and replaced.
+// the Shaders belong to the cache and live until release() or the end of the cache, they must not be deleted by the caller.
+class ProgramCache {
+public:
+    // an empty dir keeps programs in memory only
+    ProgramCache(std::string dir = "shader_cache") : dir(dir) {}
+
+    // the instance() is destroyed after the context, so only the Shader objects go here, see release()
+    ~ProgramCache() {
+        for (auto& p : programs) delete p.second;
+    }
+
+    // deletes every program while the context is still current, call it once no Render uses them anymore, before the
+    // context is destroyed. later get()s build them again
+    void release() {
+        for (auto& p : programs) {
+            glDeleteProgram(p.second->ID);
+            delete p.second;
+        }
+        programs.clear();
+    }
+
+    // cache of the process, the directory can be changed with the RENDER_SHADER_CACHE environment variable
+    static ProgramCache& instance() {
+        static ProgramCache cache(getenv("RENDER_SHADER_CACHE") ? getenv("RENDER_SHADER_CACHE") : "shader_cache");
+        return cache;
+    }
+
+    Shader* get(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+        void (*beforeLink)(unsigned int program) = nullptr) {
+        std::string vertexCode, fragmentCode, geometryCode;
+        if (!readSource(vertexPath, vertexCode) || !readSource(fragmentPath, fragmentCode) ||
+            (geometryPath != nullptr && !readSource(geometryPath, geometryCode))) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << vertexPath << " " << fragmentPath << std::endl;
+        }
+        return getFromSource(vertexCode, fragmentCode, geometryCode, vertexPath, fragmentPath, beforeLink);
+    }
+
+    // the file read once and kept for the life of the cache, so programs regenerated from the same files (a new wing
+    // calibration, a new wing model) do not go back to disk. files that could not be read are tried again next time
+    bool readSource(const char* path, std::string& code) {
+        auto it = sources.find(path);
+        if (it != sources.end()) {
+            code = it->second;
+            return true;
+        }
+        if (!Shader::readFile(path, code)) return false;
+        sources[path] = code;
+        return true;
+    }
+
+    // vertexName and fragmentName only show up in compile errors. beforeLink sets link time state such as transform feedback
+    // varyings, it is not part of the key: sources that need it must not be used without it
+    Shader* getFromSource(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode = "",
+        const char* vertexName = "", const char* fragmentName = "", void (*beforeLink)(unsigned int program) = nullptr) {
+        unsigned long long key = sourceHash(vertexCode, fragmentCode, geometryCode);
+        auto it = programs.find(key);
+        if (it != programs.end()) return it->second;
+
+        names.push_back(vertexName);
+        names.push_back(fragmentName);
+        Shader* shader = new Shader();
+        auto nameIt = names.end();
+        shader->fp = (--nameIt)->c_str();
+        shader->vp = (--nameIt)->c_str();
+        if (!loadBinary(key, *shader)) {
+            bool isRetrievable = isBinarySupported();
+            shader->compile(vertexCode, fragmentCode, geometryCode, [=](unsigned int program) {
+                if (isRetrievable) setRetrievable(program);
+                if (beforeLink) beforeLink(program);
+            });
+            saveBinary(key, *shader);
+        }
+        programs[key] = shader;
+        return shader;
+    }
+
+    int programCount() { return (int)programs.size(); }
+    int getBinaryHits() { return binaryHits; }
+
+private:
+    std::string dir;
+    std::map<unsigned long long, Shader*> programs;
+    std::map<std::string, std::string> sources;
+    std::list<std::string> names;       // the Shaders point into it, a list never moves its strings
+    int binaryHits = 0;
+    int binarySupport = -1;             // -1 unknown yet
+    std::string driver;
+    PFNRMGETPROGRAMBINARY getProgramBinary = NULL;
+    PFNRMPROGRAMBINARY programBinary = NULL;
+
+    // FNV-1a over the sources, with a separator so that moving text between the stages changes the hash
+    static unsigned long long fnv1a(const std::string& s, unsigned long long h) {
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        h ^= 0xff;
+        h *= 1099511628211ull;
+        return h;
+    }
+
+    static unsigned long long sourceHash(const std::string& v, const std::string& f, const std::string& g) {
+        return fnv1a(g, fnv1a(f, fnv1a(v, 14695981039346656037ull)));
+    }
+
+    static void setRetrievable(unsigned int program) {
+        PFNRMPROGRAMPARAMETERI programParameteri = (PFNRMPROGRAMPARAMETERI)glfwGetProcAddress("glProgramParameteri");
+        if (programParameteri) programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    bool isBinarySupported() {
+        if (binarySupport >= 0) return binarySupport == 1;
+        binarySupport = 0;
+        if (dir.empty()) return false;
+        bool hasExtension = false;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && !strcmp(ext, "GL_ARB_get_program_binary")) hasExtension = true;
+        }
+        GLint formats = 0;
+        if (hasExtension) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        getProgramBinary = (PFNRMGETPROGRAMBINARY)glfwGetProcAddress("glGetProgramBinary");
+        programBinary = (PFNRMPROGRAMBINARY)glfwGetProcAddress("glProgramBinary");
+        if (formats <= 0 || !getProgramBinary || !programBinary) return false;
+        const char* vendor = (const char*)glGetString(GL_VENDOR);
+        const char* renderer = (const char*)glGetString(GL_RENDERER);
+        const char* version = (const char*)glGetString(GL_VERSION);
+        driver = std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+        binarySupport = 1;
+        return true;
+    }
+
+    std::string binaryPath(unsigned long long key) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", fnv1a(driver, key));
+        return dir + "/" + name;
+    }
+
+    // file: "RMPB", driver string length and text, binary format, binary length and data
+    bool loadBinary(unsigned long long key, Shader& shader) {
+        if (!isBinarySupported()) return false;
+        FILE* fp = fopen(binaryPath(key).c_str(), "rb");
+        if (!fp) return false;
+        char magic[4];
+        unsigned int driverLength = 0, format = 0, length = 0;
+        std::string fileDriver;
+        std::vector<char> binary;
+        bool ok = fread(magic, 1, 4, fp) == 4 && !memcmp(magic, "RMPB", 4) && fread(&driverLength, 4, 1, fp) == 1 && driverLength < 4096;
+        if (ok) {
+            fileDriver.resize(driverLength);
+            ok = fread(&fileDriver[0], 1, driverLength, fp) == driverLength && fileDriver == driver
+                && fread(&format, 4, 1, fp) == 1 && fread(&length, 4, 1, fp) == 1 && length > 0;
+        }
+        if (ok) {
+            binary.resize(length);
+            ok = fread(binary.data(), 1, length, fp) == length;
+        }
+        fclose(fp);
+        if (!ok) return false;
+        shader.ID = glCreateProgram();
+        programBinary(shader.ID, format, binary.data(), (GLsizei)length);
+        GLint linked = 0;
+        glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(shader.ID);
+            shader.ID = 0;
+            return false;
+        }
+        binaryHits++;
+        return true;
+    }
+
+    // written to a temporary name first, so that a worker starting at the same time never reads half a file
+    void saveBinary(unsigned long long key, Shader& shader) {
+        if (!isBinarySupported()) return;
+        GLint linked = 0, length = 0;
+        glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+        glGetProgramiv(shader.ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!linked || length <= 0) return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        getProgramBinary(shader.ID, length, &written, &format, binary.data());
+        if (written <= 0) return;
+        std::string path = binaryPath(key);
+        std::string tmpPath = path + "." + std::to_string((unsigned long long)(size_t)this) + ".tmp";
+        FILE* fp = fopen(tmpPath.c_str(), "wb");
+        if (!fp) return;
+        unsigned int driverLength = (unsigned int)driver.size(), format32 = format, length32 = (unsigned int)written;
+        bool ok = fwrite("RMPB", 1, 4, fp) == 4 && fwrite(&driverLength, 4, 1, fp) == 1
+            && fwrite(driver.data(), 1, driverLength, fp) == driverLength && fwrite(&format32, 4, 1, fp) == 1
+            && fwrite(&length32, 4, 1, fp) == 1 && fwrite(binary.data(), 1, written, fp) == (size_t)written;
+        ok = fclose(fp) == 0 && ok;
+        if (ok) {
+            remove(path.c_str());
+            ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+        }
+        if (!ok) remove(tmpPath.c_str());
+    }
+};
+
+#endif
@@ -0,0 +1,215 @@
+// Python bindings, module `rendermodel`. separate extension, build it from this file and glad.c instead of kernel.cpp:
+//
+//   c++ -O2 -shared -fPIC -std=c++17 $(python3 -m pybind11 --includes) pyrendermodel.cpp glad.c -lglfw -lassimp \
+//       -o rendermodel$(python3-config --extension-suffix)
+//
+//   import rendermodel as rm
+//   rm.create_context(1920, 1440)              # first, models and programs live in this context
+//   C = rm.CameraPara(); C.width = 1920; C.height = 1440; ...
+//   camera = rm.Camera(C)
+//   render = rm.Render(camera, body=rm.Model("model/body.obj"), wing=rm.Model("model/wing.obj"))
+//   render.set_model_transform(rm.ModelTransformDesc(tz=-3000))
+//   render.draw()
+//   img = render.read_image()                  # numpy array over a readback buffer of the Render, nothing copied
+//
+// read_image/read_pos borrow a buffer from the Render's ReadbackPool, read the last draw into it and hand it to numpy
+// as is. the arrays are top row first: they start at GL's last row and step backwards through the buffer. the buffer
+// goes back to the pool once the array and every view of it are gone, so at most readback_buffers outputs can be alive
+// at a time, take a copy (np.array(img)) of those that are kept longer.
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define _CRT_SECURE_NO_WARNINGS
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/eigen.h>
+#include <pybind11/stl.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "stb_image_write.h"
+#include "shader.h"
+#include "model.h"
+#include "camera.h"
+#include "render.h"
+#include "glcontext.h"
+
+namespace py = pybind11;
+
+static GLFWwindow* window = NULL;
+
+// a pool buffer lent to a numpy array. holds the Python Render, so the pool is still there when the buffer comes back
+struct PoolLease {
+    py::object owner;
+    ReadbackPool* pool;
+    void* buffer;
+};
+
+static py::array leaseArray(py::object owner, ReadbackPool* pool, void* buffer, py::dtype dtype, int width, int height, int channels) {
+    PoolLease* lease = new PoolLease{ owner, pool, buffer };
+    py::capsule base(lease, [](void* p) {
+        PoolLease* l = (PoolLease*)p;
+        l->pool->release(l->buffer);
+        delete l;
+    });
+    py::ssize_t item = dtype.itemsize();
+    py::ssize_t row = (py::ssize_t)width * channels * item;
+    std::vector<py::ssize_t> shape = { height, width };
+    std::vector<py::ssize_t> strides = { -row, channels * item };
+    if (channels > 1) {
+        shape.push_back(channels);
+        strides.push_back(item);
+    }
+    char* top = (char*)buffer + (py::ssize_t)(height - 1) * row;
+    return py::array(dtype, shape, strides, top, base);
+}
+
+static void* acquireReadback(Render& render) {
+    ReadbackPool* pool = render.getReadbackPool();
+    void* buffer = pool ? pool->acquire() : NULL;
+    if (!buffer) throw std::runtime_error("no free readback buffer, drop older outputs or raise readback_buffers");
+    return buffer;
+}
+
+static py::array readImage(py::object self) {
+    Render& render = self.cast<Render&>();
+    void* buffer = acquireReadback(render);
+    render.readImage((unsigned char*)buffer);
+    RenderROI roi = render.getROI();
+    return leaseArray(self, render.getReadbackPool(), buffer, py::dtype::of<unsigned char>(), roi.width, roi.height, render.getImageChannels());
+}
+
+static py::array readPos(py::object self) {
+    Render& render = self.cast<Render&>();
+    void* buffer = acquireReadback(render);
+    if (!render.readPos((float*)buffer)) {
+        render.getReadbackPool()->release(buffer);
+        throw std::runtime_error("can not read the pos output");
+    }
+    RenderROI roi = render.getROI();
+    return leaseArray(self, render.getReadbackPool(), buffer, py::dtype::of<float>(), roi.width, roi.height, 3);
+}
+
+PYBIND11_MODULE(rendermodel, m) {
+    m.doc() = "render the body and wing models with OpenGL, outputs as numpy arrays";
+
+    m.def("create_context", [](int width, int height, bool headless, bool software) {
+        if (window) throw std::runtime_error("the GL context exists already");
+        window = createGLContext(width, height, headless, software);
+    }, py::arg("width"), py::arg("height"), py::arg("headless") = true, py::arg("software") = false);
+
+    py::class_<CameraPara>(m, "CameraPara")
+        .def(py::init<>())
+        .def_readwrite("width", &CameraPara::width)
+        .def_readwrite("height", &CameraPara::height)
+        .def_readwrite("f", &CameraPara::f)
+        .def_readwrite("dx", &CameraPara::dx)
+        .def_readwrite("dy", &CameraPara::dy)
+        .def_readwrite("x0", &CameraPara::x0)
+        .def_readwrite("y0", &CameraPara::y0)
+        .def_readwrite("zNear", &CameraPara::zNear)
+        .def_readwrite("zFar", &CameraPara::zFar)
+        .def_readwrite("k1", &CameraPara::k1)
+        .def_readwrite("k2", &CameraPara::k2)
+        .def_readwrite("p1", &CameraPara::p1)
+        .def_readwrite("p2", &CameraPara::p2)
+        .def_readwrite("k3", &CameraPara::k3);
+
+    py::class_<Camera>(m, "Camera")
+        .def(py::init<CameraPara, V3f, V3f, float, float>(), py::arg("para"),
+            py::arg("position") = V3f(0.0f, 0.0f, 3.0f), py::arg("up") = V3f(0.0f, 1.0f, 0.0f),
+            py::arg("yaw") = -90.0f, py::arg("pitch") = 0.0f)
+        .def_property("view_matrix", [](Camera& c) { return M4f(c.getViewMatrix()); }, &Camera::setViewMatrix)
+        .def_property_readonly("perspective_matrix", [](Camera& c) { return M4f(c.getPerspectiveMatrix()); })
+        .def_property("para", &Camera::getCameraPara, &Camera::setCameraPara)
+        .def_property_readonly("position", &Camera::getPosition)
+        .def_property_readonly("width", &Camera::getWidth)
+        .def_property_readonly("height", &Camera::getHeight);
+
+    py::class_<ModelTransformDesc>(m, "ModelTransformDesc")
+        .def(py::init([](float tx, float ty, float tz, float rx, float ry, float rz, float scale) {
+            ModelTransformDesc d;
+            d.tx = tx; d.ty = ty; d.tz = tz;
+            d.rx = rx; d.ry = ry; d.rz = rz;
+            d.scale = scale;
+            return d;
+        }), py::arg("tx") = 0.0f, py::arg("ty") = 0.0f, py::arg("tz") = 0.0f,
+            py::arg("rx") = 0.0f, py::arg("ry") = 0.0f, py::arg("rz") = 0.0f, py::arg("scale") = 1.0f)
+        .def_readwrite("tx", &ModelTransformDesc::tx)
+        .def_readwrite("ty", &ModelTransformDesc::ty)
+        .def_readwrite("tz", &ModelTransformDesc::tz)
+        .def_readwrite("rx", &ModelTransformDesc::rx)
+        .def_readwrite("ry", &ModelTransformDesc::ry)
+        .def_readwrite("rz", &ModelTransformDesc::rz)
+        .def_readwrite("scale", &ModelTransformDesc::scale);
+
+    // an undeformed wing (Model(path)) is bent by Render.wing_g, Model(path, degree, G) bakes G into the mesh
+    py::class_<Model>(m, "Model")
+        .def(py::init([](std::string const& path) {
+            if (!window) throw std::runtime_error("call create_context() first");
+            return new Model(path);
+        }), py::arg("path"))
+        .def(py::init([](std::string const& path, int degree, float G) {
+            if (!window) throw std::runtime_error("call create_context() first");
+            return new Model(path, degree, G);
+        }), py::arg("path"), py::arg("degree"), py::arg("G"))
+        .def("save_model", &Model::saveModel, py::arg("path") = std::string("./model/output.obj"))
+        .def("calibrate_wing", &Model::calibrateWing, py::arg("G"));
+
+    // the Render keeps its camera and models alive, they are used by every draw
+    py::class_<Render>(m, "Render")
+        .def(py::init([](Camera* camera, Model* body, Model* wing, ModelTransformDesc* transform, bool gray, bool msaa,
+            bool distortion, std::string const& background, int readbackBuffers) {
+            if (!window) throw std::runtime_error("call create_context() first");
+            if (!camera || (!body && !wing)) throw std::runtime_error("a camera and at least one of body and wing are needed");
+            ModelTransformDesc identity;
+            RenderDesc d;
+            d.camera = camera;
+            d.bodyModel = body;
+            d.wingModel = wing;
+            d.tranDesc = transform ? transform : &identity;
+            d.isRenderGrayImage = gray;
+            d.isMSAAEnable = msaa;
+            d.isDistortionEnable = distortion;
+            d.isRenderBackGround = !background.empty();
+            d.bgImagePath = background;
+            d.readbackBuffers = readbackBuffers;
+            return new Render(d);
+        }), py::arg("camera"), py::arg("body") = py::none(), py::arg("wing") = py::none(), py::arg("transform") = py::none(),
+            py::arg("gray") = false, py::arg("msaa") = false, py::arg("distortion") = false, py::arg("background") = std::string(),
+            py::arg("readback_buffers") = 4,
+            py::keep_alive<1, 2>(), py::keep_alive<1, 3>(), py::keep_alive<1, 4>())
+        .def("set_camera", &Render::setC, py::arg("camera"), py::keep_alive<1, 2>())
+        .def("set_models", &Render::setModels, py::arg("body"), py::arg("wing"), py::keep_alive<1, 2>(), py::keep_alive<1, 3>())
+        .def("set_model_transform", &Render::setModelTransform, py::arg("transform"))
+        .def_property_readonly("model_matrix", &Render::getModelMatrix)
+        .def_property("wing_g", &Render::getWingG, &Render::setWingG)
+        .def("set_gray", &Render::setGrayRenderStatus, py::arg("status"))
+        .def("set_msaa", &Render::setMSAAStatus, py::arg("status"))
+        .def("set_distortion", &Render::setDistortionStatus, py::arg("status"))
+        // pos is only allocated while it is on. read_pos turns it on and draws again, set_pos(True) before the draw avoids that
+        .def("set_pos", &Render::setPosRenderStatus, py::arg("status"))
+        .def("set_background_image", &Render::setbgImagePath, py::arg("path"))
+        .def("set_background", &Render::setbgRenderStatus, py::arg("status"))
+        .def("draw", [](Render& r) { return r.draw(); })
+        // only the roi is drawn and read back, the outputs are width x height
+        .def("draw", [](Render& r, int x, int y, int width, int height) {
+            RenderROI roi;
+            roi.x = x; roi.y = y; roi.width = width; roi.height = height;
+            return r.draw(roi);
+        }, py::arg("x"), py::arg("y"), py::arg("width"), py::arg("height"))
+        .def_property_readonly("roi", [](Render& r) {
+            RenderROI roi = r.getROI();
+            return py::make_tuple(roi.x, roi.y, roi.width, roi.height);
+        })
+        .def("generate_image", &Render::generateImage, py::arg("path") = "output.png")
+        // uint8 (height, width, 3), or (height, width) in gray mode
+        .def("read_image", &readImage)
+        // float32 (height, width, 3) model space position, 1e6 where nothing was drawn
+        .def("read_pos", &readPos)
+        .def_property_readonly("readback_free", [](Render& r) {
+            return r.getReadbackPool() ? r.getReadbackPool()->getFreeCount() : 0;
+        })
+        .def_property_readonly("gpu_memory_bytes", &Render::getGpuMemoryBytes);
+}
@@ -0,0 +1,95 @@
+#ifndef READBACKPOOL_H
+#define READBACKPOOL_H
+
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+// aligned heap memory, for buffers handed to glReadPixels or SIMD code
+inline void* alignedAlloc(size_t bytes, size_t alignment = 64) {
+#ifdef _WIN32
+    return _aligned_malloc(bytes, alignment);
+#else
+    void* p = NULL;
+    if (posix_memalign(&p, alignment, bytes ? bytes : alignment) != 0) return NULL;
+    return p;
+#endif
+}
+
+inline void alignedFree(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// a fixed number of equally sized, 64 byte aligned buffers allocated once. acquire() lends one out until it is
+// release()d, so a render loop that takes and returns its buffers allocates nothing after construction.
+class ReadbackPool {
+public:
+    ReadbackPool(size_t bufferBytes, int count) : bufferBytes(bufferBytes) {
+        for (int i = 0; i < count; i++) {
+            void* p = alignedAlloc(bufferBytes);
+            if (!p) {
+                printf("can not allocate readback buffer %d of %zu bytes\n", i, bufferBytes);
+                break;
+            }
+            buffers.push_back(p);
+        }
+        for (int i = (int)buffers.size() - 1; i >= 0; i--) freeSlots.push_back(i);
+        isLent.assign(buffers.size(), 0);
+    }
+
+    ~ReadbackPool() {
+        if (freeSlots.size() != buffers.size())
+            printf("%zu readback buffers were not released\n", buffers.size() - freeSlots.size());
+        for (void* p : buffers) alignedFree(p);
+    }
+
+    // NULL when every buffer is lent out
+    void* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeSlots.empty()) return NULL;
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        isLent[slot] = 1;
+        return buffers[slot];
+    }
+
+    // a buffer released twice is refused, it would otherwise be lent to two users at once
+    void release(void* p) {
+        if (!p) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(buffers.begin(), buffers.end(), p);
+        if (it == buffers.end()) {
+            printf("buffer does not belong to this pool\n");
+            return;
+        }
+        int slot = (int)(it - buffers.begin());
+        if (!isLent[slot]) {
+            printf("readback buffer %d was released twice\n", slot);
+            return;
+        }
+        isLent[slot] = 0;
+        freeSlots.push_back(slot);
+    }
+
+    size_t getBufferBytes() { return bufferBytes; }
+    int getBufferCount() { return (int)buffers.size(); }
+    int getFreeCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (int)freeSlots.size();
+    }
+
+private:
+    size_t bufferBytes;
+    std::vector<void*> buffers;
+    std::vector<int> freeSlots;         // holds every slot after construction, push_back never reallocates
+    std::vector<char> isLent;           // per slot, set from acquire() to release()
+    std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#version 330 core
+
+in vec2 TexCoords;
+
+uniform sampler2D distortionMap;
+uniform sampler2D colorTexture;
+uniform sampler2D posTexture;
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec3 Pos;
+
+void main(){
+    vec2 uv = texture(distortionMap, TexCoords).xy;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0)))) {
+        // seen by the real lens but outside of the pinhole frustum
+        FragColor = vec4(0.0);
+        Pos = vec3(1e6, 1e6, 1e6);
+        return;
+    }
+    FragColor = texture(colorTexture, uv);
+    // positions must not be blended across silhouette edges
+    Pos = texelFetch(posTexture, ivec2(uv * vec2(textureSize(posTexture, 0))), 0).xyz;
+}
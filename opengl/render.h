@@ -6,6 +6,18 @@
 #include "camera.h"
 #include "model.h"
 #include "helper_cuda.h"
+#include "bgsource.h"
+#include "posebatch.h"
+#include "profiler.h"
+#include "imagewriter.h"
+#include "scene.h"
+#include "programcache.h"
+#include "readbackpool.h"
+#include "keypoints.h"
+#include "distancefield.h"
+#include <functional>
+#include <algorithm>
+#include <cfloat>
 #include <string>
 typedef Eigen::Vector3f V3f;
 typedef Eigen::Matrix4f M4f;
@@ -20,140 +32,311 @@ struct ModelTransformDesc {
     float scale = 1;
 };
 
+// scale * R_x * R_y * R_z with the translation, the model matrix a ModelTransformDesc stands for
+inline M4f calculateModelMatrix(const ModelTransformDesc& d) {
+    Eigen::Matrix3f rotation;
+    rotation = Eigen::AngleAxisf(d.rx, V3f::UnitX())
+        * Eigen::AngleAxisf(d.ry, V3f::UnitY())
+        * Eigen::AngleAxisf(d.rz, V3f::UnitZ());
+    M4f modelM = M4f::Identity();
+    modelM.block<3, 1>(0, 3) = V3f(d.tx, d.ty, d.tz);
+    modelM.block<3, 3>(0, 0) = d.scale * rotation;
+    return modelM;
+}
+
+// sub-rectangle of the frame in pixels, bottom-left origin like CameraPara::x0/y0
+struct RenderROI {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// a pixel covered by a mesh, see Render::readIds
+struct RenderIdPixel {
+    unsigned int x;             // output pixel, bottom-left origin like the other outputs
+    unsigned int y;
+    unsigned int mesh;          // body meshes first, then wing meshes, then the meshes of the scene
+    unsigned int triangle;      // index of the triangle in its mesh
+};
+
+// copy of the color, pos and depth layers of intermediateFBO, written back into it with blits
+struct LayerCache {
+    unsigned int fbo = 0;
+    unsigned int colorTexture = 0;
+    unsigned int posTexture = 0;
+    unsigned int depthBuffer = 0;
+    unsigned int idTexture = 0;             // only while the id output is on
+    bool isValid = false;
+};
+
 struct RenderDesc {
     bool isRenderBackGround = false;
     bool isRenderGrayImage = false;
     bool isMSAAEnable = false;
+    bool isDistortionEnable = false;
+    // pos output, see Render::setPosRenderStatus. off by default, so a job that only reads the image allocates no RGB32F
+    // target and no pos layers in the layer caches
+    bool isPosEnable = false;
     Camera* camera = 0;
     Model* bodyModel = 0;
     Model* wingModel = 0;
+    // drawn in one pass in addition to bodyModel/wingModel, either is enough
+    Scene* scene = 0;
     ModelTransformDesc* tranDesc = 0;
+    RenderProfiler* profiler = 0;
     std::string bgImagePath = "";
+    // buffers in getReadbackPool(), each big enough for any full-frame output, allocated once here
+    int readbackBuffers = 0;
 };
 
 class Render {
 public:
     Render(RenderDesc d);
+    ~Render();
     inline void setC(Camera* c);
     void setModelTransform(ModelTransformDesc* d);
     M4f getModelMatrix() { return modelMatrix; }
+    // swap the models drawn by this Render, at least one of them must be set
+    void setModels(Model* body, Model* wing);
+    // draw a Scene in a single pass with the model matrix of this Render, NULL removes it
+    void setScene(Scene* s);
+    // a still background, replaces a source set with setbgSource()
     void setbgImagePath(std::string imgPath);
+    // stream backgrounds from a source, decoded `prefetch` frames ahead by `workers` threads. the source must outlive the Render
+    void setbgSource(BackgroundSource* source, int prefetch = 4, int workers = 2);
+    // switch to the next frame of the background source, returns false at the end of the stream or when the frame can not be
+    // uploaded. draw() leaves the background out until the first frame is there
+    bool nextbgFrame();
 
     // ޸ǷʹöزͬʱúҪframe buffer
     void setMSAAStatus(bool status);
-    void draw();
+    bool getMSAAStatus() { return isMSAAEnable; }
+    // false when nothing was drawn (gray with MSAA), the outputs still hold the last draw then
+    bool draw();
+    // render only roi, with the principal point shifted so that the roi fills a roi-sized corner (0, 0, w, h) of the targets.
+    // the roi is cleared first, as the whole frame is by draw(). readback and encoding then only touch roi.width x roi.height pixels.
+    // false when the roi is outside the frame or partial with distortion on
+    bool draw(RenderROI roi);
+    // region covered by the last draw, the outputs hold getROI().width x getROI().height pixels
+    RenderROI getROI() { return roi; }
+    // draw once per pose of the batch with the current camera intrinsics, onFrame(i) is called after pose i is drawn
+    // so the outputs can be read back. the camera is left at the last pose.
+    void drawPoses(const PoseBatch& poses, std::function<void(int)> onFrame);
+    // wing load G evaluated by wingShader.vs on top of the wing mesh, use an undeformed wing model (Model(path)) with it
+    void setWingG(float G) { wingG = G; }
+    float getWingG() { return wingG; }
+    // evaluate the wing calibration from a 1D lookup texture of `samples` texels over the wing's x range instead of the
+    // constant-folded polynomials. one texture fetch per vertex, accurate to the linear interpolation between samples
+    void setWingLutStatus(bool status, int samples = 1024);
+    // incremental mode for when only G changes: draws background and body once and caches their layers, then draws the wing.
+    // call it again whenever anything but G changes (camera, pose, background, models, gray). MSAA and ROI are not supported,
+    // neither is a Scene: its deformed models take G from the scene pass, which drawWing() does not repeat
+    bool beginIncremental();
+    // redraw only the wing with load G: the cached layers are restored inside the old and new wing screen bounds,
+    // and the wing is drawn scissored to them, so the cost follows the wing footprint instead of the frame
+    void drawWing(float G);
+    // the png is written from a buffer owned by the Render, reused from one call to the next
     void generateImage(const char* filepath = "output.png");
-    void getDepthInfo();
+    // render an image of any size (e.g. beyond GL_MAX_TEXTURE_SIZE) with the current view, one tile of this Render's size at a time.
+    // rows are streamed into a .png, .tif or raw file, memory stays at one row of tiles. the camera is restored afterwards.
+    // with distortion on, each tile is drawn with a margin of the largest shift of the lens around it and only its inside is
+    // kept, so the tiles join like one distorted image. that fails when the image is smaller than the Render or the
+    // margin takes half of it
+    bool generateTiledImage(CameraPara full, const char* filepath);
+    // pos of the last draw, valid until the next call. the buffer is allocated on the first call only
+    const float* getDepthInfo();
+    // copy the outputs of the last draw into caller memory, rows bottom-up and tightly packed, getROI().width x getROI().height.
+    // readImage writes getImageChannels() bytes per pixel (RGB, or R in gray mode), readPos 3 floats. nothing is allocated
+    bool readImage(unsigned char* dst);
+    bool readPos(float* dst);
+    int getImageChannels() { return isRenderGrayImage ? 1 : 3; }
+    // fixed pool of RenderDesc::readbackBuffers aligned buffers of getReadbackBytes() to pass to readImage/readPos,
+    // NULL when none were asked for. buffers are acquire()d and release()d by the caller and freed with the Render
+    ReadbackPool* getReadbackPool() { return readbackPool; }
+    size_t getReadbackBytes() { return (size_t)SCR_WIDTH * SCR_HEIGHT * 3 * sizeof(float); }
+    // GPU memory held by this Render right now: render targets, layer caches, feedback buffers, lookup and background
+    // textures. estimated from sizes and formats with RGB counted as RGBA, as drivers store it. the programs are shared
+    // through the ProgramCache and not counted
+    size_t getGpuMemoryBytes();
     void setbgRenderStatus(bool status);
     void setGrayRenderStatus(bool status);
-    unsigned int getGrayTexture() { return grayTexture; }
-    unsigned int getPosTexture() { return posTexture; }
+    // the pos output is only allocated while it is on, a 12 byte per pixel target and its copies in the layer caches.
+    // readPos, getDepthInfo, computeDistanceField and projectKeypoints turn it on themselves and draw the last frame again
+    // the first time, turning it on before the draw saves that second draw
+    void setPosRenderStatus(bool status);
+    // apply the lens distortion of the camera to every output, so they line up with raw camera images
+    void setDistortionStatus(bool status);
+    unsigned int getScreenTexture() { return isDistortionEnable ? distortScreenTexture : screenTexture; }
+    unsigned int getGrayTexture() { return isDistortionEnable ? distortGrayTexture : grayTexture; }
+    unsigned int getPosTexture() { return isDistortionEnable ? distortPosTexture : posTexture; }
+    // a third output written in the same pass as pos: RG32UI (mesh + 1, triangle) of the visible surface, 0 where no mesh
+    // was drawn. mesh counts body meshes, then wing meshes, then scene meshes. not resolved from MSAA and not distorted,
+    // so the id reads below refuse while either is on. off releases the id target and the id layers of the layer caches
+    void setIdRenderStatus(bool status);
+    unsigned int getIdTexture() { return idTexture; }
+    // covered pixels of the last draw only, compacted on the GPU in pixel order. writes at most capacity of them into dst
+    // and returns how many there are, -1 on error. capacity 0 just counts
+    int readIds(RenderIdPixel* dst, int capacity);
+    // the whole id output, 2 unsigned ints per pixel, getROI().width x getROI().height
+    bool readIdImage(unsigned int* dst);
+    // project the points with the camera, model matrix and wing G of the last draw, one transform feedback pass on the GPU.
+    // a point is visible when no surface of the last draw lies more than tolerance (model units) in front of it. pixel
+    // coordinates are those of the undistorted outputs. writes points.size() entries to dst, returns their count, -1 on error
+    int projectKeypoints(KeypointSet& points, RenderKeypoint* dst, float tolerance = 0.5f);
+    // distance field of the edges of the last draw, on the GPU: silhouette and occlusion edges where pos jumps by more than
+    // jumpThreshold (model units), creases where it bends by more than creaseAngle degrees (180 turns them off)
+    bool computeDistanceField(float jumpThreshold = 1.0f, float creaseAngle = 30.0f);
+    // mean distance in pixels from image edge points (x, y pairs in output pixels, bottom-left origin) to the nearest rendered
+    // edge, each capped at truncation. reads back one pixel. -1 when no point is inside the output
+    float chamferScore(const float* points, int n, float truncation = 20.0f, int* inside = NULL);
+    // the field itself, getROI().width x getROI().height floats, rows bottom-up
+    bool readDistanceField(float* dst);
+    unsigned int getDistanceFieldTexture() { return distanceField ? distanceField->getTexture() : 0; }
+    // per stage timings are collected into the profiler while it is set, NULL turns profiling off
+    void setProfiler(RenderProfiler* p) { profiler = p; }
+    RenderProfiler* getProfiler() { return profiler; }
+    Camera* getCamera() { return camera; }
+    Model* getBodyModel() { return bodyModel; }
+    Model* getWingModel() { return wingModel; }
+    Scene* getScene() { return scene; }
+    // everything besides pose, G, camera and models that changes the outputs, one bit per setting
+    unsigned int getModeFlags() {
+        return (isRenderBackGround ? 1u : 0u) | (isRenderGrayImage ? 2u : 0u) | (isMSAAEnable ? 4u : 0u)
+            | (isDistortionEnable ? 8u : 0u) | (isWingLut ? 16u : 0u);
+    }
 private:
     Camera* camera;
     Shader* bodyShaderColor = NULL;
     Shader* bodyShaderGray = NULL;
-    // ʵȾʱʹͬshaderļ޸뵽render캯
+    // the wing programs run wingShader.vs with the wing model's calibration generated into it, which bends the wing by wingG
     Shader* wingShaderColor = NULL;
-    // ʵȾʱʹͬshaderļ޸뵽render캯
     Shader* wingShaderGray = NULL;
     Shader* bgShaderColor = NULL;
     Shader* bgShaderGray = NULL;
     Model* bodyModel = NULL;
     Model* wingModel = NULL;
+    Scene* scene = NULL;
+    Shader* sceneShaderColor = NULL;
+    Shader* sceneShaderGray = NULL;
     std::string bgImagePath = "";
     M4f modelMatrix;
     int SCR_WIDTH;
     int SCR_HEIGHT;
-    unsigned int framebuffer;
-    unsigned int textureColorBufferMultiSampled;
-    unsigned int posColorBufferMultiSampled;
-    unsigned int rbo;
-    unsigned int intermediateFBO;
-    unsigned int grayTexture;
-    unsigned int screenTexture;
-    unsigned int posTexture;
+    // targets are 0 while the mode does not write them, see updateTargets()
+    unsigned int framebuffer = 0;
+    unsigned int textureColorBufferMultiSampled = 0;
+    unsigned int rbo = 0;
+    unsigned int intermediateFBO = 0;
+    unsigned int grayTexture = 0;
+    unsigned int screenTexture = 0;
+    unsigned int posTexture = 0;
+    unsigned int intermediateDepth = 0;
+    bool isPosEnable;
     float* pPos = NULL;
+    std::vector<GLubyte> imageBuffer;
+    ReadbackPool* readbackPool = NULL;
     bool isRenderBackGround;
     bool isRenderGrayImage;
     bool isMSAAEnable;
-    unsigned int bgVAO;
-    unsigned int bgVBO;
-    unsigned int bgTexture;
+    unsigned int bgVAO = 0;
+    unsigned int bgVBO = 0;
+    unsigned int bgTexture = 0;
+    size_t bgTextureBytes = 0;
+    BackgroundStreamer* bgStreamer = NULL;
+    BackgroundUploader* bgUploader = NULL;
+    bool isDistortionEnable = false;
+    Shader* remapShader = NULL;
+    unsigned int distortFBO = 0;
+    unsigned int distortScreenTexture = 0;
+    unsigned int distortGrayTexture = 0;
+    unsigned int distortPosTexture = 0;
+    unsigned int distortionMapTexture = 0;
+    Camera* distortionMapCamera = NULL;
+    int distortionMapVersion = -1;
+    RenderProfiler* profiler = NULL;
+    Eigen::Vector4f bgRect = Eigen::Vector4f(0, 0, 1, 1);
+    RenderROI roi;
+    float wingG = 0;
+    LayerCache wingCache;
+    LayerCache bgCache[2];                  // the background alone, color and gray mode
+    RenderROI wingRect;                     // pixels touched by the wing in the last drawWing()
+    Model* wingBoundsModel = NULL;          // wing the bounds below belong to
+    V3f wingBoxMin, wingBoxMax;             // undeformed bounding box of the wing
+    float wingOffsetMin, wingOffsetMax;     // range of the z offset per unit G over the wing vertices
+    WingCalibration wingCalib;              // the calibration the wing and scene programs were generated from
+    bool isWingLut = false;
+    int wingLutSamples = 1024;
+    unsigned int wingLutTexture = 0;
+    Eigen::Vector2f wingLutRange;
+    static const int WING_LUT_UNIT = 4;
+    bool isIdEnable = false;
+    unsigned int idTexture = 0;
+    Shader* idCompactShader = NULL;
+    unsigned int idCompactVAO = 0;
+    unsigned int idCompactBuffer = 0;       // transform feedback target of readIds
+    int idCompactCapacity = 0;
+    unsigned int idCompactQuery = 0;
+    Shader* keypointShader = NULL;          // generated from the wing calibration on first use
+    unsigned int keypointBuffer = 0;
+    int keypointCapacity = 0;
+    DistanceField* distanceField = NULL;
+
+    unsigned int getOutputFBO() { return isDistortionEnable ? distortFBO : intermediateFBO; }
+    void readOutput(GLenum attachment, GLenum format, GLenum type, void* dst);
+
+    void stageBegin(RenderStage s) { if (profiler) profiler->begin(s); }
+    void stageEnd(RenderStage s) { if (profiler) profiler->end(s); }
+
+    void applyDistortion();
+    unsigned int getColorOutputTexture();
+
+    void drawWingModel(Shader* shader, const M4f& perspective);
+    void updateTargets();
+    unsigned int createTarget(GLenum attachment, GLenum internalFormat, GLenum format, GLenum type, GLenum filter);
+    static void deleteTexture(unsigned int& texture) { if (texture) glDeleteTextures(1, &texture); texture = 0; }
+    static void deleteRenderbuffer(unsigned int& buffer) { if (buffer) glDeleteRenderbuffers(1, &buffer); buffer = 0; }
+    void createLayerCache(LayerCache& cache);
+    void releaseLayerCache(LayerCache& cache);
+    void blitLayers(unsigned int srcFBO, unsigned int dstFBO, RenderROI r);
+    void updateWingBounds();
+    RenderROI getWingScreenRect(float G);
+    void updateWingPrograms();
+    void setDrawBuffers();
+    void enablePos();
+    unsigned int attachIdTexture(unsigned int fbo);
+    unsigned int firstMeshId(Model* m) { return 1 + (m != bodyModel && bodyModel ? (unsigned int)bodyModel->meshes.size() : 0); }
+    unsigned int firstSceneMeshId() { return firstMeshId(wingModel) + (wingModel ? (unsigned int)wingModel->meshes.size() : 0); }
 };
 
 Render::Render(RenderDesc d){
-    if (!d.camera || (!d.bodyModel && !d.wingModel)) {
+    if (!d.camera || (!d.bodyModel && !d.wingModel && !d.scene)) {
         printf("RenderDesc is incomplete, program exiting...\n");
         exit(-1);
     }
     camera = d.camera;
     SCR_WIDTH = camera->getWidth();
     SCR_HEIGHT = camera->getHeight();
+    roi.width = SCR_WIDTH;
+    roi.height = SCR_HEIGHT;
     isRenderBackGround = d.isRenderBackGround;
     isRenderGrayImage = d.isRenderGrayImage;
     isMSAAEnable = d.isMSAAEnable;
+    isPosEnable = d.isPosEnable;
     bgImagePath = d.bgImagePath;
+    profiler = d.profiler;
+    if (d.readbackBuffers > 0) readbackPool = new ReadbackPool(getReadbackBytes(), d.readbackBuffers);
 
     stbi_set_flip_vertically_on_load(true);
     glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_MULTISAMPLE);
 
-    // ȶ׼framebufferintermediateFBO֮Ҫĸﻭ
+    // only the framebuffers here, setMSAAStatus() below attaches the targets the mode writes to and remakes them
+    // whenever the mode changes
     glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-    // framebuffer
-    glGenTextures(1, &textureColorBufferMultiSampled);
-    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled);
-    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGB, SCR_WIDTH, SCR_HEIGHT, GL_TRUE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled, 0);
-    // framebufferȻ
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << std::endl;
-
-    // intermediateFBO
     glGenFramebuffers(1, &intermediateFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-
-    glGenTextures(1, &screenTexture);
-    glBindTexture(GL_TEXTURE_2D, screenTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    if (!isRenderGrayImage)glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenTexture, 0);
 
-    glGenTextures(1, &grayTexture);
-    glBindTexture(GL_TEXTURE_2D, grayTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SCR_WIDTH, SCR_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    if (isRenderGrayImage)glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, grayTexture, 0);
-
-    glGenTextures(1, &posTexture);
-    glBindTexture(GL_TEXTURE_2D, posTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, posTexture, 0);
-
-    unsigned int rbo2;
-    glGenRenderbuffers(1, &rbo2);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo2);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo2);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    
     // ñ黺棬zֵΪԶƽzֵԱ֤Ⱦʱ
     float bgVertices[] = { // λ 
         -1.0f,  1.0f,  0.0f, 1.0f,
@@ -175,35 +358,102 @@ Render::Render(RenderDesc d){
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
     glGenTextures(1, &bgTexture);
 
-    bodyShaderColor = new Shader("objectShader.vs", "objectShader.fs");
-    bodyShaderGray = new Shader("objectShader.vs", "objectShader_gray.fs");
-    wingShaderColor = new Shader("objectShader.vs", "objectShader.fs");
-    wingShaderGray = new Shader("objectShader.vs", "objectShader_gray.fs");
-    bgShaderColor = new Shader("bgShader.vs", "bgShader.fs");
-    bgShaderGray = new Shader("bgShader.vs", "bgShader_gray.fs");
+    // programs are shared with every other Render of the process and kept on disk between processes
+    ProgramCache& programs = ProgramCache::instance();
+    bodyShaderColor = programs.get("objectShader.vs", "objectShader.fs");
+    bodyShaderGray = programs.get("objectShader.vs", "objectShader_gray.fs");
+    bgShaderColor = programs.get("bgShader.vs", "bgShader.fs");
+    bgShaderGray = programs.get("bgShader.vs", "bgShader_gray.fs");
     bodyModel = d.bodyModel;
     wingModel = d.wingModel;
+    if (d.scene) setScene(d.scene);
+    else updateWingPrograms();
     if(!bgImagePath.empty()) setbgImagePath(d.bgImagePath);
     setMSAAStatus(d.isMSAAEnable);
     setModelTransform(d.tranDesc);
+    setDistortionStatus(d.isDistortionEnable);
 }
 
 void Render::setModelTransform(ModelTransformDesc* d) {
-    float tx = d->tx; float ty = d->ty; float tz = d->tz;
-    float rx = d->rx; float ry = d->ry; float rz = d->rz;
-    float scale = d->scale;
-    Eigen::Matrix3f rotation;
-    rotation = Eigen::AngleAxisf(rx, V3f::UnitX())
-        * Eigen::AngleAxisf(ry, V3f::UnitY())
-        * Eigen::AngleAxisf(rz, V3f::UnitZ());
-    V3f translation(tx, ty, tz);
-    M4f modelM = M4f::Identity();
-    modelM.block<3, 1>(0, 3) = translation;
-    modelM.block<3, 3>(0, 0) = scale * rotation;
-    modelMatrix = modelM;
+    modelMatrix = calculateModelMatrix(*d);
+    wingCache.isValid = false;
+}
+
+void Render::setModels(Model* body, Model* wing) {
+    if (!body && !wing && !scene) {
+        printf("at least one of body and wing model is needed\n");
+        return;
+    }
+    bodyModel = body;
+    wingModel = wing;
+    wingCache.isValid = false;
+    updateWingPrograms();
+}
+
+void Render::setScene(Scene* s) {
+    if (!s && !bodyModel && !wingModel) {
+        printf("at least one of body and wing model is needed\n");
+        return;
+    }
+    scene = s;
+    wingCache.isValid = false;
+    updateWingPrograms();
+}
+
+void Render::setWingLutStatus(bool status, int samples) {
+    isWingLut = status;
+    wingLutSamples = samples > 1 ? samples : 2;
+    updateWingPrograms();
+}
+
+// (re)generates the wing and scene programs from the calibration of the wing model, the ProgramCache hands back
+// the same programs when nothing changed
+void Render::updateWingPrograms() {
+    if (wingModel) wingCalib = wingModel->wingCalib;
+    keypointShader = NULL;
+    ProgramCache& programs = ProgramCache::instance();
+    std::string vertexCode, colorCode, grayCode;
+    if (!programs.readSource("objectShader.fs", colorCode) || !programs.readSource("objectShader_gray.fs", grayCode))
+        printf("can not read objectShader.fs or objectShader_gray.fs\n");
+    if (wingModel) {
+        if (!programs.readSource("wingShader.vs", vertexCode)) printf("can not read wingShader.vs\n");
+        vertexCode = wingCalib.shaderSource(vertexCode, isWingLut);
+        wingShaderColor = programs.getFromSource(vertexCode, colorCode, "", "wingShader.vs", "objectShader.fs");
+        wingShaderGray = programs.getFromSource(vertexCode, grayCode, "", "wingShader.vs", "objectShader_gray.fs");
+        if (isWingLut) {
+            updateWingBounds();
+            std::vector<float> lut;
+            wingCalib.buildLut(wingBoxMin.x(), wingBoxMax.x(), wingLutSamples, lut);
+            if (!wingLutTexture) glGenTextures(1, &wingLutTexture);
+            glBindTexture(GL_TEXTURE_1D, wingLutTexture);
+            glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA32F, wingLutSamples, 0, GL_RGBA, GL_FLOAT, lut.data());
+            glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_1D, 0);
+            wingLutRange = WingCalibration::lutRange(wingBoxMin.x(), wingBoxMax.x(), wingLutSamples);
+        }
+    }
+    if (scene) {
+        // a scene can hold any model, so it always gets the exact constant variant
+        std::string sceneVertexCode, sceneColorCode, sceneGrayCode;
+        if (!programs.readSource("sceneShader.vs", sceneVertexCode) || !programs.readSource("sceneShader.fs", sceneColorCode) ||
+            !programs.readSource("sceneShader_gray.fs", sceneGrayCode))
+            printf("can not read the sceneShader files\n");
+        sceneVertexCode = wingCalib.shaderSource(sceneVertexCode, false);
+        sceneShaderColor = programs.getFromSource(sceneVertexCode, sceneColorCode, "", "sceneShader.vs", "sceneShader.fs");
+        sceneShaderGray = programs.getFromSource(sceneVertexCode, sceneGrayCode, "", "sceneShader.vs", "sceneShader_gray.fs");
+    }
 }
 
 void Render::setbgImagePath(std::string imagePath) {
+    bgImagePath = imagePath;
+    bgCache[0].isValid = bgCache[1].isValid = false;
+    // a still image replaces a stream set before, draw() samples the stream texture while there is a streamer
+    delete bgStreamer;
+    bgStreamer = NULL;
+    delete bgUploader;
+    bgUploader = NULL;
     //رͼ
     int width, height, nchannels;
     unsigned char* data = stbi_load(imagePath.c_str(), &width, &height, &nchannels, 0);
@@ -213,6 +463,8 @@ void Render::setbgImagePath(std::string imagePath) {
     glBindTexture(GL_TEXTURE_2D, bgTexture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
+    // RGBA as stored, the mipmaps add a third
+    bgTextureBytes = data ? (size_t)width * height * 4 * 4 / 3 : 0;
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -220,11 +472,46 @@ void Render::setbgImagePath(std::string imagePath) {
     stbi_image_free(data);
 }
 
+void Render::setbgSource(BackgroundSource* source, int prefetch, int workers) {
+    delete bgStreamer;
+    bgStreamer = new BackgroundStreamer(source, prefetch, workers);
+    bgCache[0].isValid = bgCache[1].isValid = false;
+    if (!bgUploader) bgUploader = new BackgroundUploader();
+    bgUploader->discard();
+}
+
+bool Render::nextbgFrame() {
+    if (!bgStreamer) {
+        printf("use setbgSource() before nextbgFrame()\n");
+        return false;
+    }
+    // the frame shown was staged at the end of the previous call when it was decoded by then, otherwise it is waited for
+    // here. a source fed by the caller between calls (RingBufferSource) is never waited for ahead of time
+    if (!bgUploader->hasStaged()) {
+        BgFrame* frame = bgStreamer->acquire();
+        if (!frame) return false;
+        // a frame that could not be staged stays in the streamer for the next call
+        if (!bgUploader->stage(*frame)) {
+            printf("can not map the background upload buffer\n");
+            return false;
+        }
+        bgStreamer->release();
+    }
+    bgUploader->commit();
+    // the next frame is copied while the GPU transfers and draws this one
+    if (BgFrame* next = bgStreamer->tryAcquire()) {
+        if (bgUploader->stage(*next)) bgStreamer->release();
+    }
+    bgCache[0].isValid = bgCache[1].isValid = false;
+    return true;
+}
+
 void Render::setMSAAStatus(bool status) {
     // ʱֻȾɫframebuffer֮תƵintermediaFBO
     // رտʱͬʱȾɫλãֱȾintermediaFBO
     // Ҷֱȥ мFBO 
     isMSAAEnable = status;
+    updateTargets();
     glClearColor(0, 0, 0, 0);
     if (isMSAAEnable) {
         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
@@ -233,98 +520,863 @@ void Render::setMSAAStatus(bool status) {
     }
     else {
         glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-        const GLenum buffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-        glDrawBuffers(2, buffers);
+        setDrawBuffers();
         glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        // pos holds 1e6 wherever nothing is drawn, with or without background
+        if (isPosEnable) {
+            const GLfloat far[4] = { 1e6f, 1e6f, 1e6f, 1e6f };
+            glClearBufferfv(GL_COLOR, 1, far);
+        }
+        // glClear leaves integer buffers undefined
+        if (isIdEnable) {
+            const GLuint none[4] = { 0, 0, 0, 0 };
+            glClearBufferuiv(GL_COLOR, 2, none);
+        }
+    }
+}
+
+// color, and pos and the ids while they are on. GL 3.3 counts a draw buffer without an attachment as incomplete
+void Render::setDrawBuffers() {
+    const GLenum buffers[]{ GL_COLOR_ATTACHMENT0, isPosEnable ? GL_COLOR_ATTACHMENT1 : (GLenum)GL_NONE, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(isIdEnable ? 3 : 2, buffers);
+}
+
+// attaches what the current mode writes to and releases the rest: the multisampled color and depth only with MSAA, the
+// color or the gray target, pos while it is on, and the depth of intermediateFBO only without MSAA, when it is drawn
+// into directly. the distorted copies follow color, gray and pos while distortion is on. cheap when nothing changed
+void Render::updateTargets() {
+    bool isChanged = false;
+    if (isMSAAEnable && !textureColorBufferMultiSampled) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenTextures(1, &textureColorBufferMultiSampled);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGB, SCR_WIDTH, SCR_HEIGHT, GL_TRUE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled, 0);
+        glGenRenderbuffers(1, &rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: multisampled framebuffer is not complete!" << std::endl;
+    }
+    if (!isMSAAEnable) {
+        deleteTexture(textureColorBufferMultiSampled);
+        deleteRenderbuffer(rbo);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+    deleteTexture(isRenderGrayImage ? screenTexture : grayTexture);
+    unsigned int& color = isRenderGrayImage ? grayTexture : screenTexture;
+    if (!color) {
+        GLenum format = isRenderGrayImage ? GL_RED : GL_RGB;
+        color = createTarget(GL_COLOR_ATTACHMENT0, format, format, GL_UNSIGNED_BYTE, GL_LINEAR);
+        isChanged = true;
+    }
+    if (isPosEnable && !posTexture) {
+        posTexture = createTarget(GL_COLOR_ATTACHMENT1, GL_RGB32F, GL_RGB, GL_FLOAT, GL_LINEAR);
+        isChanged = true;
+    }
+    if (!isPosEnable) deleteTexture(posTexture);
+    if (!isMSAAEnable && !intermediateDepth) {
+        glGenRenderbuffers(1, &intermediateDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, intermediateDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, intermediateDepth);
+        isChanged = true;
+    }
+    if (isMSAAEnable) deleteRenderbuffer(intermediateDepth);
+    if (isChanged && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << std::endl;
+
+    if (!distortFBO) return;
+    glBindFramebuffer(GL_FRAMEBUFFER, distortFBO);
+    deleteTexture(isRenderGrayImage ? distortScreenTexture : distortGrayTexture);
+    unsigned int& distortColor = isRenderGrayImage ? distortGrayTexture : distortScreenTexture;
+    if (!distortColor) {
+        GLenum format = isRenderGrayImage ? GL_RED : GL_RGB;
+        distortColor = createTarget(GL_COLOR_ATTACHMENT0, format, format, GL_UNSIGNED_BYTE, GL_LINEAR);
+    }
+    if (isPosEnable && !distortPosTexture) distortPosTexture = createTarget(GL_COLOR_ATTACHMENT1, GL_RGB32F, GL_RGB, GL_FLOAT, GL_LINEAR);
+    if (!isPosEnable) deleteTexture(distortPosTexture);
+}
+
+// a SCR_WIDTH x SCR_HEIGHT texture attached to the bound framebuffer
+unsigned int Render::createTarget(GLenum attachment, GLenum internalFormat, GLenum format, GLenum type, GLenum filter) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, SCR_WIDTH, SCR_HEIGHT, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+    return texture;
+}
+
+size_t Render::getGpuMemoryBytes() {
+    size_t pixels = (size_t)SCR_WIDTH * SCR_HEIGHT;
+    size_t bytes = 0;
+    auto add = [&](unsigned int object, size_t bytesPerPixel) { if (object) bytes += pixels * bytesPerPixel; };
+    add(textureColorBufferMultiSampled, 4 * 4);
+    add(rbo, 4 * 4);
+    add(screenTexture, 4);
+    add(grayTexture, 1);
+    add(posTexture, 16);
+    add(intermediateDepth, 4);
+    add(idTexture, 8);
+    add(distortScreenTexture, 4);
+    add(distortGrayTexture, 1);
+    add(distortPosTexture, 16);
+    add(distortionMapTexture, 8);
+    const LayerCache* caches[] = { &wingCache, &bgCache[0], &bgCache[1] };
+    for (const LayerCache* cache : caches) {
+        add(cache->colorTexture, 4);
+        add(cache->posTexture, 16);
+        add(cache->depthBuffer, 4);
+        add(cache->idTexture, 8);
     }
+    bytes += (size_t)idCompactCapacity * sizeof(RenderIdPixel) + (size_t)keypointCapacity * sizeof(RenderKeypoint);
+    if (wingLutTexture) bytes += (size_t)wingLutSamples * 4 * sizeof(float);
+    bytes += bgTextureBytes;
+    if (bgUploader) bytes += bgUploader->getGpuMemoryBytes();
+    if (distanceField) bytes += distanceField->getGpuMemoryBytes();
+    return bytes;
 }
 
-void Render::draw(){
+bool Render::draw(){
+    RenderROI full;
+    full.width = SCR_WIDTH;
+    full.height = SCR_HEIGHT;
+    return draw(full);
+}
+
+bool Render::draw(RenderROI r){
     if (isMSAAEnable && isRenderGrayImage) {
         printf("render gray image while enable MSAA is not supported\n");
-        return;
+        return false;
+    }
+    if (r.x < 0 || r.y < 0 || r.width <= 0 || r.height <= 0 || r.x + r.width > SCR_WIDTH || r.y + r.height > SCR_HEIGHT) {
+        printf("ROI is outside of the frame\n");
+        return false;
+    }
+    bool isFullFrame = r.width == SCR_WIDTH && r.height == SCR_HEIGHT;
+    if (!isFullFrame && isDistortionEnable) {
+        printf("ROI rendering while enable distortion is not supported\n");
+        return false;
+    }
+    roi = r;
+    wingCache.isValid = false;
+    M4f perspective = camera->getPerspectiveMatrix();
+    Eigen::Vector4f bgRectInUse = bgRect;
+    if (!isFullFrame) {
+        perspective = camera->getSubPerspectiveMatrix(roi.x, roi.y, roi.width, roi.height);
+        bgRectInUse.head<2>() += bgRect.tail<2>().cwiseProduct(Eigen::Vector2f((float)roi.x / SCR_WIDTH, (float)roi.y / SCR_HEIGHT));
+        bgRectInUse.tail<2>() = bgRect.tail<2>().cwiseProduct(Eigen::Vector2f((float)roi.width / SCR_WIDTH, (float)roi.height / SCR_HEIGHT));
     }
+    // full frames and rois start from the same cleared color, pos and ids, the pixels outside the roi are kept
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, roi.width, roi.height);
+    setMSAAStatus(isMSAAEnable);
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(0, 0, roi.width, roi.height);
     Shader* bodyShaderInUse = bodyShaderGray;
-    Shader* wingShaderInUse = wingShaderGray;
     Shader* bgShaderInUse = bgShaderGray;
     if (!isRenderGrayImage) {
         bodyShaderInUse = bodyShaderColor;
-        wingShaderInUse = wingShaderColor;
         bgShaderInUse = bgShaderColor;
     }
-    if (isRenderBackGround) {
-        bgShaderInUse->use();
-        bgShaderInUse->setInt("bgTexture", 0);
-        glBindVertexArray(bgVAO);
-        glBindTexture(GL_TEXTURE_2D, bgTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
+    // a stream shows nothing until nextbgFrame() has uploaded its first frame
+    if (isRenderBackGround && (!bgStreamer || bgUploader->hasFrame())) {
+        stageBegin(STAGE_BACKGROUND);
+        // the background layers only change with the image, so for full frames without MSAA they are shaded once
+        // per mode into bgCache and every later frame starts with a copy of them instead
+        bool isCacheable = !isMSAAEnable && isFullFrame && bgRect == Eigen::Vector4f(0, 0, 1, 1);
+        LayerCache& cache = bgCache[isRenderGrayImage ? 1 : 0];
+        if (isCacheable && cache.isValid) {
+            blitLayers(cache.fbo, intermediateFBO, roi);
+        }
+        else {
+            // the cache must hold nothing but the background
+            if (isCacheable) setMSAAStatus(false);
+            bgShaderInUse->use();
+            bgShaderInUse->setInt("bgTexture", 0);
+            bgShaderInUse->setVec4("bgRect", bgRectInUse);
+            glBindVertexArray(bgVAO);
+            glBindTexture(GL_TEXTURE_2D, bgStreamer ? bgUploader->getTexture() : bgTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glBindVertexArray(0);
+            if (isCacheable) {
+                if (!cache.fbo) createLayerCache(cache);
+                blitLayers(intermediateFBO, cache.fbo, roi);
+                cache.isValid = true;
+            }
+        }
+        stageEnd(STAGE_BACKGROUND);
     }
-    M4f perspective = camera->getPerspectiveMatrix();
-    M4f view = camera->getViewMatrix();
+    const M4f& view = camera->getViewMatrix();
     if (bodyModel) {
+        stageBegin(STAGE_BODY);
         bodyShaderInUse->use();
         bodyShaderInUse->setMat4("perspective", perspective);
         bodyShaderInUse->setMat4("view", view);
         bodyShaderInUse->setMat4("model", modelMatrix);
-        bodyModel->Draw(*bodyShaderInUse);
+        bodyModel->Draw(*bodyShaderInUse, firstMeshId(bodyModel));
+        stageEnd(STAGE_BODY);
     }
     if (wingModel) {
-        wingShaderInUse->use();
-        wingShaderInUse->setMat4("perspective", perspective);
-        wingShaderInUse->setMat4("view", view);
-        wingShaderInUse->setMat4("model", modelMatrix);
-        // wingShaderInUse->setFloat("G", G);
-        wingModel->Draw(*wingShaderInUse);
+        stageBegin(STAGE_WING);
+        drawWingModel(isRenderGrayImage ? wingShaderGray : wingShaderColor, perspective);
+        stageEnd(STAGE_WING);
+    }
+    if (scene) {
+        stageBegin(STAGE_SCENE);
+        Shader* sceneShaderInUse = isRenderGrayImage ? sceneShaderGray : sceneShaderColor;
+        sceneShaderInUse->use();
+        sceneShaderInUse->setMat4("perspective", perspective);
+        sceneShaderInUse->setMat4("view", view);
+        sceneShaderInUse->setMat4("model", modelMatrix);
+        sceneShaderInUse->setFloat("G", wingG);
+        sceneShaderInUse->setUint("meshId", firstSceneMeshId());
+        scene->Draw(*sceneShaderInUse);
+        stageEnd(STAGE_SCENE);
     }
 
     // ݣҪframebufferеתƵintermediateFBO
     if (isMSAAEnable) {
+        stageBegin(STAGE_MSAA_BLIT);
         glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
         glReadBuffer(GL_COLOR_ATTACHMENT0);
         glDrawBuffer(GL_COLOR_ATTACHMENT0);
-        glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBlitFramebuffer(0, 0, roi.width, roi.height, 0, 0, roi.width, roi.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
         glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+        stageEnd(STAGE_MSAA_BLIT);
     }
+    if (isDistortionEnable) {
+        stageBegin(STAGE_DISTORTION);
+        applyDistortion();
+        stageEnd(STAGE_DISTORTION);
+    }
+    return true;
 }
 
-void Render::generateImage(const char* outputpath) {
-    if (!isRenderGrayImage) { //color image
-        GLubyte* pPixelData = new GLubyte[(long)SCR_HEIGHT * SCR_WIDTH * 3];
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, screenTexture);
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, pPixelData);
-        stbi_flip_vertically_on_write(true);
-        stbi_write_png(outputpath, SCR_WIDTH, SCR_HEIGHT, 3, pPixelData, 3 * SCR_WIDTH);
-        delete[] pPixelData;
+void Render::drawPoses(const PoseBatch& poses, std::function<void(int)> onFrame) {
+    for (int i = 0; i < poses.size(); i++) {
+        camera->setViewMatrix(poses.viewMatrix(i));
+        setMSAAStatus(isMSAAEnable);
+        draw();
+        if (onFrame) onFrame(i);
     }
-    else {
-        GLubyte* pPixelData = new GLubyte[(long)SCR_HEIGHT * SCR_WIDTH];
+}
+
+void Render::drawWingModel(Shader* shader, const M4f& perspective) {
+    shader->use();
+    shader->setMat4("perspective", perspective);
+    shader->setMat4("view", camera->getViewMatrix());
+    shader->setMat4("model", modelMatrix);
+    shader->setFloat("G", wingG);
+    if (isWingLut) {
+        shader->setInt("wingLut", WING_LUT_UNIT);
+        shader->setVec2("wingLutRange", wingLutRange);
+        glActiveTexture(GL_TEXTURE0 + WING_LUT_UNIT);
+        glBindTexture(GL_TEXTURE_1D, wingLutTexture);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, grayTexture);
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, pPixelData);
-        stbi_flip_vertically_on_write(true);
-        stbi_write_png(outputpath, SCR_WIDTH, SCR_HEIGHT, 1, pPixelData, SCR_WIDTH);
-        delete[] pPixelData;
     }
+    wingModel->Draw(*shader, firstMeshId(wingModel));
+}
+
+bool Render::beginIncremental() {
+    if (isMSAAEnable) {
+        printf("incremental wing rendering while enable MSAA is not supported\n");
+        return false;
+    }
+    if (!wingModel) {
+        printf("incremental wing rendering needs a wing model\n");
+        return false;
+    }
+    if (scene) {
+        printf("incremental wing rendering while a scene is set is not supported\n");
+        return false;
+    }
+    if (!wingCache.fbo) createLayerCache(wingCache);
+    // background and body only, the distortion is applied after each drawWing()
+    Model* wing = wingModel;
+    bool distortion = isDistortionEnable;
+    wingModel = NULL;
+    isDistortionEnable = false;
+    setMSAAStatus(false);
+    draw();
+    wingModel = wing;
+    isDistortionEnable = distortion;
+    blitLayers(intermediateFBO, wingCache.fbo, roi);
+    wingCache.isValid = true;
+    wingRect = RenderROI();
+    drawWing(wingG);
+    return true;
+}
+
+void Render::drawWing(float G) {
+    if (!wingCache.isValid) {
+        printf("use beginIncremental() before drawWing()\n");
+        return;
+    }
+    wingG = G;
+    RenderROI rect = getWingScreenRect(G);
+    // the old wing has to be erased as well, so the dirty region is the union of both bounds
+    RenderROI dirty = rect;
+    if (wingRect.width > 0 && wingRect.height > 0) {
+        if (dirty.width <= 0 || dirty.height <= 0) dirty = wingRect;
+        else {
+            int x1 = std::max(dirty.x + dirty.width, wingRect.x + wingRect.width);
+            int y1 = std::max(dirty.y + dirty.height, wingRect.y + wingRect.height);
+            dirty.x = std::min(dirty.x, wingRect.x);
+            dirty.y = std::min(dirty.y, wingRect.y);
+            dirty.width = x1 - dirty.x;
+            dirty.height = y1 - dirty.y;
+        }
+    }
+    wingRect = rect;
+    stageBegin(STAGE_WING);
+    if (dirty.width > 0 && dirty.height > 0) {
+        blitLayers(wingCache.fbo, intermediateFBO, dirty);
+        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(dirty.x, dirty.y, dirty.width, dirty.height);
+        if (rect.width > 0 && rect.height > 0)
+            drawWingModel(isRenderGrayImage ? wingShaderGray : wingShaderColor, camera->getPerspectiveMatrix());
+        glDisable(GL_SCISSOR_TEST);
+    }
+    stageEnd(STAGE_WING);
+    if (isDistortionEnable) {
+        stageBegin(STAGE_DISTORTION);
+        applyDistortion();
+        stageEnd(STAGE_DISTORTION);
+    }
+}
+
+void Render::createLayerCache(LayerCache& cache) {
+    glGenFramebuffers(1, &cache.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, cache.fbo);
+    // RGB holds the gray image as well, blits convert between the color formats
+    cache.colorTexture = createTarget(GL_COLOR_ATTACHMENT0, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE, GL_NEAREST);
+    if (isPosEnable) cache.posTexture = createTarget(GL_COLOR_ATTACHMENT1, GL_RGB32F, GL_RGB, GL_FLOAT, GL_NEAREST);
+    // same format as the depth buffer of intermediateFBO, depth blits need an exact match
+    glGenRenderbuffers(1, &cache.depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, cache.depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, cache.depthBuffer);
+    if (isIdEnable) cache.idTexture = attachIdTexture(cache.fbo);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: layer cache framebuffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+}
+
+void Render::releaseLayerCache(LayerCache& cache) {
+    deleteTexture(cache.colorTexture);
+    deleteTexture(cache.posTexture);
+    deleteTexture(cache.idTexture);
+    deleteRenderbuffer(cache.depthBuffer);
+    if (cache.fbo) glDeleteFramebuffers(1, &cache.fbo);
+    cache.fbo = 0;
+    cache.isValid = false;
+}
+
+// copies color, depth, and pos and the ids while they are on inside r, a blit writes to every draw buffer so the colors go one at a time
+void Render::blitLayers(unsigned int srcFBO, unsigned int dstFBO, RenderROI r) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, srcFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dstFBO);
+    for (int i = 0; i < (isIdEnable ? 3 : 2); i++) {
+        if (i == 1 && !isPosEnable) continue;
+        glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0 + i);
+        glBlitFramebuffer(r.x, r.y, r.x + r.width, r.y + r.height, r.x, r.y, r.x + r.width, r.y + r.height,
+            GL_COLOR_BUFFER_BIT | (i == 0 ? GL_DEPTH_BUFFER_BIT : 0), GL_NEAREST);
+    }
+    setDrawBuffers();
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+}
+
+unsigned int Render::attachIdTexture(unsigned int fbo) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, SCR_WIDTH, SCR_HEIGHT, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, texture, 0);
+    return texture;
+}
+
+void Render::setIdRenderStatus(bool status) {
+    if (status && isMSAAEnable) {
+        printf("id rendering while enable MSAA is not supported\n");
+        return;
+    }
+    isIdEnable = status;
+    LayerCache* caches[] = { &wingCache, &bgCache[0], &bgCache[1] };
+    if (!isIdEnable) {
+        // the id layers go with the mode, the framebuffers other than the bound one keep an attachment until it is removed
+        for (LayerCache* cache : caches) {
+            if (!cache->idTexture) continue;
+            glBindFramebuffer(GL_FRAMEBUFFER, cache->fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, 0, 0);
+            deleteTexture(cache->idTexture);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, 0, 0);
+        deleteTexture(idTexture);
+        setDrawBuffers();
+        return;
+    }
+    if (!idTexture) idTexture = attachIdTexture(intermediateFBO);
+    // layer caches made before hold no ids, they get an id layer and are filled again
+    for (LayerCache* cache : caches) {
+        if (!cache->fbo || cache->idTexture) continue;
+        cache->idTexture = attachIdTexture(cache->fbo);
+        cache->isValid = false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+}
+
+static void setIdCompactVaryings(unsigned int program) {
+    const char* varyings[] = { "Record" };
+    glTransformFeedbackVaryings(program, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+}
+
+// one point per pixel through idCompact.gs, which emits only covered pixels into a transform feedback buffer.
+// GL_PRIMITIVES_GENERATED counts them all, also those that did not fit into the buffer
+int Render::readIds(RenderIdPixel* dst, int capacity) {
+    if (!isIdEnable || isMSAAEnable || isDistortionEnable) {
+        printf("readIds needs setIdRenderStatus(true), without MSAA and distortion\n");
+        return -1;
+    }
+    if (!idCompactShader) {
+        idCompactShader = ProgramCache::instance().get("idCompact.vs", "feedback.fs", "idCompact.gs", setIdCompactVaryings);
+        glGenVertexArrays(1, &idCompactVAO);
+        glGenBuffers(1, &idCompactBuffer);
+        glGenQueries(1, &idCompactQuery);
+    }
+    // transform feedback needs a buffer with storage even when only counting
+    int needed = std::max(capacity, 1);
+    if (needed > idCompactCapacity) {
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, idCompactBuffer);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, (GLsizeiptr)needed * sizeof(RenderIdPixel), NULL, GL_STREAM_READ);
+        idCompactCapacity = needed;
+    }
+    stageBegin(STAGE_READBACK);
+    // nothing is rasterized, but the id texture must not be sampled while attached to the draw framebuffer
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    idCompactShader->use();
+    idCompactShader->setInt("idTexture", 0);
+    idCompactShader->setInt("width", roi.width);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, idTexture);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, idCompactBuffer);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, idCompactQuery);
+    glBeginTransformFeedback(GL_POINTS);
+    glBindVertexArray(idCompactVAO);
+    glDrawArrays(GL_POINTS, 0, roi.width * roi.height);
+    glBindVertexArray(0);
+    glEndTransformFeedback();
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    glDisable(GL_RASTERIZER_DISCARD);
+    GLuint covered = 0;
+    glGetQueryObjectuiv(idCompactQuery, GL_QUERY_RESULT, &covered);
+    int count = std::min((int)covered, capacity);
+    if (count > 0 && dst) {
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, idCompactBuffer);
+        glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, (GLsizeiptr)count * sizeof(RenderIdPixel), dst);
+    }
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
+    stageEnd(STAGE_READBACK);
+    return (int)covered;
+}
+
+static void setKeypointVaryings(unsigned int program) {
+    const char* varyings[] = { "Projected", "Visible" };
+    glTransformFeedbackVaryings(program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+}
+
+int Render::projectKeypoints(KeypointSet& points, RenderKeypoint* dst, float tolerance) {
+    if (isMSAAEnable) {
+        printf("keypoint visibility while enable MSAA is not supported\n");
+        return -1;
+    }
+    int n = points.size();
+    if (n == 0 || !dst) return 0;
+    enablePos();
+    if (!keypointShader) {
+        // always the exact constant variant, a wing drawn from the lookup table differs from it far less than tolerance
+        ProgramCache& programs = ProgramCache::instance();
+        std::string vertexCode, fragmentCode;
+        if (!programs.readSource("keypoint.vs", vertexCode) || !programs.readSource("feedback.fs", fragmentCode))
+            printf("can not read keypoint.vs or feedback.fs\n");
+        keypointShader = programs.getFromSource(wingCalib.shaderSource(vertexCode, false), fragmentCode, "",
+            "keypoint.vs", "feedback.fs", setKeypointVaryings);
+    }
+    // the program is regenerated when the wing calibration changes, the buffer is kept
+    if (!keypointBuffer) glGenBuffers(1, &keypointBuffer);
+    if (n > keypointCapacity) {
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, keypointBuffer);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, (GLsizeiptr)n * sizeof(RenderKeypoint), NULL, GL_STREAM_READ);
+        keypointCapacity = n;
+    }
+    unsigned int vao = points.getVAO();
+    bool isFullFrame = roi.width == SCR_WIDTH && roi.height == SCR_HEIGHT;
+    M4f perspective = isFullFrame ? camera->getPerspectiveMatrix() : camera->getSubPerspectiveMatrix(roi.x, roi.y, roi.width, roi.height);
+    stageBegin(STAGE_READBACK);
+    // the pos texture must not be sampled while attached to the draw framebuffer
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    keypointShader->use();
+    keypointShader->setMat4("perspective", perspective);
+    keypointShader->setMat4("view", camera->getViewMatrix());
+    keypointShader->setMat4("model", modelMatrix);
+    keypointShader->setFloat("G", wingG);
+    keypointShader->setFloat("tolerance", tolerance);
+    keypointShader->setVec2("outputSize", (float)roi.width, (float)roi.height);
+    keypointShader->setInt("posTexture", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, posTexture);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, keypointBuffer);
+    glBeginTransformFeedback(GL_POINTS);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_POINTS, 0, n);
+    glBindVertexArray(0);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, keypointBuffer);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, (GLsizeiptr)n * sizeof(RenderKeypoint), dst);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
+    stageEnd(STAGE_READBACK);
+    return n;
+}
+
+bool Render::readIdImage(unsigned int* dst) {
+    if (!isIdEnable || isMSAAEnable || isDistortionEnable || !dst) {
+        printf("readIdImage needs setIdRenderStatus(true), without MSAA and distortion\n");
+        return false;
+    }
+    stageBegin(STAGE_READBACK);
+    readOutput(GL_COLOR_ATTACHMENT2, GL_RG_INTEGER, GL_UNSIGNED_INT, dst);
+    stageEnd(STAGE_READBACK);
+    return true;
+}
+
+void Render::updateWingBounds() {
+    if (wingBoundsModel == wingModel) return;
+    wingBoxMin = V3f::Constant(FLT_MAX);
+    wingBoxMax = V3f::Constant(-FLT_MAX);
+    wingOffsetMin = FLT_MAX;
+    wingOffsetMax = -FLT_MAX;
+    for (auto& mesh : wingModel->meshes) {
+        for (auto& v : mesh.vertices) {
+            wingBoxMin = wingBoxMin.cwiseMin(v.Position);
+            wingBoxMax = wingBoxMax.cwiseMax(v.Position);
+            float offset = wingModel->wingCalib.offset(v.Position) / wingModel->wingCalib.referenceG;
+            wingOffsetMin = std::min(wingOffsetMin, offset);
+            wingOffsetMax = std::max(wingOffsetMax, offset);
+        }
+    }
+    wingBoundsModel = wingModel;
+}
+
+// conservative pixel bounds of the wing at load G: the 8 corners of its deformed bounding box projected, padded by 2 pixels
+RenderROI Render::getWingScreenRect(float G) {
+    updateWingBounds();
+    RenderROI full;
+    full.width = SCR_WIDTH;
+    full.height = SCR_HEIGHT;
+    if (wingBoxMin.x() > wingBoxMax.x()) return RenderROI();
+    V3f lo = wingBoxMin, hi = wingBoxMax;
+    lo.z() += std::min(G * wingOffsetMin, G * wingOffsetMax);
+    hi.z() += std::max(G * wingOffsetMin, G * wingOffsetMax);
+    M4f mvp = camera->getPerspectiveMatrix() * camera->getViewMatrix() * modelMatrix;
+    float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        Eigen::Vector4f c(i & 1 ? hi.x() : lo.x(), i & 2 ? hi.y() : lo.y(), i & 4 ? hi.z() : lo.z(), 1);
+        Eigen::Vector4f p = mvp * c;
+        // a corner behind the camera can land anywhere on screen
+        if (p.w() <= 0) return full;
+        float px = (p.x() / p.w() + 1) * 0.5f * SCR_WIDTH;
+        float py = (p.y() / p.w() + 1) * 0.5f * SCR_HEIGHT;
+        x0 = std::min(x0, px); x1 = std::max(x1, px);
+        y0 = std::min(y0, py); y1 = std::max(y1, py);
+    }
+    int ix0 = std::max((int)std::floor(x0) - 2, 0), iy0 = std::max((int)std::floor(y0) - 2, 0);
+    int ix1 = std::min((int)std::ceil(x1) + 2, SCR_WIDTH), iy1 = std::min((int)std::ceil(y1) + 2, SCR_HEIGHT);
+    if (ix0 >= ix1 || iy0 >= iy1) return RenderROI();
+    RenderROI rect;
+    rect.x = ix0;
+    rect.y = iy0;
+    rect.width = ix1 - ix0;
+    rect.height = iy1 - iy0;
+    return rect;
 }
 
-void Render::getDepthInfo() {
-    pPos = new float[(long)SCR_HEIGHT * SCR_WIDTH * 3];
+void Render::setDistortionStatus(bool status) {
+    isDistortionEnable = status;
+    if (!isDistortionEnable) {
+        // the distorted copies are only kept while distortion is on
+        if (!distortFBO) return;
+        deleteTexture(distortScreenTexture);
+        deleteTexture(distortGrayTexture);
+        deleteTexture(distortPosTexture);
+        deleteTexture(distortionMapTexture);
+        glDeleteFramebuffers(1, &distortFBO);
+        distortFBO = 0;
+        distortionMapCamera = NULL;
+        glBindFramebuffer(GL_FRAMEBUFFER, isMSAAEnable ? framebuffer : intermediateFBO);
+        return;
+    }
+    if (distortFBO) return;
+    // distorted copies of the outputs, the pinhole render stays in intermediateFBO. the map is not attached
+    glGenFramebuffers(1, &distortFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, distortFBO);
+    distortionMapTexture = createTarget(GL_COLOR_ATTACHMENT0, GL_RG32F, GL_RG, GL_FLOAT, GL_LINEAR);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    updateTargets();
+    remapShader = ProgramCache::instance().get("bgShader.vs", "remapShader.fs");
+    glBindFramebuffer(GL_FRAMEBUFFER, isMSAAEnable ? framebuffer : intermediateFBO);
+}
+
+void Render::applyDistortion() {
+    // the map only depends on the intrinsics, rebuild it when the camera or its parameters changed
+    if (distortionMapCamera != camera || distortionMapVersion != camera->getIntrinsicVersion()) {
+        std::vector<float> map;
+        camera->calculateDistortionMap(map);
+        glBindTexture(GL_TEXTURE_2D, distortionMapTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RG, GL_FLOAT, map.data());
+        distortionMapCamera = camera;
+        distortionMapVersion = camera->getIntrinsicVersion();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, distortFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, isRenderGrayImage ? distortGrayTexture : distortScreenTexture, 0);
+    const GLenum buffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(isPosEnable ? 2 : 1, buffers);
+    glDisable(GL_DEPTH_TEST);
+    remapShader->use();
+    remapShader->setInt("distortionMap", 0);
+    remapShader->setInt("colorTexture", 1);
+    remapShader->setInt("posTexture", 2);
+    remapShader->setVec4("bgRect", 0, 0, 1, 1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, distortionMapTexture);
     glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, isRenderGrayImage ? grayTexture : screenTexture);
+    glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, posTexture);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, pPos);
+    glBindVertexArray(bgVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+}
+
+// every GL object of this Render, the programs belong to the ProgramCache and stay. the context must still be current
+Render::~Render() {
+    setDistortionStatus(false);
+    releaseLayerCache(wingCache);
+    releaseLayerCache(bgCache[0]);
+    releaseLayerCache(bgCache[1]);
+    deleteTexture(textureColorBufferMultiSampled);
+    deleteRenderbuffer(rbo);
+    deleteTexture(screenTexture);
+    deleteTexture(grayTexture);
+    deleteTexture(posTexture);
+    deleteTexture(idTexture);
+    deleteRenderbuffer(intermediateDepth);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteFramebuffers(1, &intermediateFBO);
+    if (idCompactVAO) glDeleteVertexArrays(1, &idCompactVAO);
+    if (idCompactBuffer) glDeleteBuffers(1, &idCompactBuffer);
+    if (idCompactQuery) glDeleteQueries(1, &idCompactQuery);
+    if (keypointBuffer) glDeleteBuffers(1, &keypointBuffer);
+    deleteTexture(wingLutTexture);
+    glDeleteVertexArrays(1, &bgVAO);
+    glDeleteBuffers(1, &bgVBO);
+    deleteTexture(bgTexture);
+    // the streamer first, its workers may still be decoding
+    delete bgStreamer;
+    delete bgUploader;
+    delete[] pPos;
+    delete readbackPool;
+    delete distanceField;
+}
+
+bool Render::computeDistanceField(float jumpThreshold, float creaseAngle) {
+    if (isMSAAEnable) {
+        printf("distance field while enable MSAA is not supported\n");
+        return false;
+    }
+    enablePos();
+    if (!distanceField) distanceField = new DistanceField(SCR_WIDTH, SCR_HEIGHT);
+    stageBegin(STAGE_DISTANCE_FIELD);
+    // from the pos output as it is read back, distorted when distortion is on
+    distanceField->compute(getPosTexture(), roi.width, roi.height, jumpThreshold, creaseAngle);
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+    glViewport(0, 0, roi.width, roi.height);
+    stageEnd(STAGE_DISTANCE_FIELD);
+    return true;
+}
+
+float Render::chamferScore(const float* points, int n, float truncation, int* inside) {
+    if (!distanceField || !distanceField->isComputed()) {
+        printf("use computeDistanceField() before chamferScore()\n");
+        return -1;
+    }
+    stageBegin(STAGE_DISTANCE_FIELD);
+    float score = distanceField->chamfer(points, n, truncation, inside);
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+    glViewport(0, 0, roi.width, roi.height);
+    stageEnd(STAGE_DISTANCE_FIELD);
+    return score;
+}
+
+bool Render::readDistanceField(float* dst) {
+    if (!distanceField || !distanceField->isComputed() || !dst) {
+        printf("use computeDistanceField() before readDistanceField()\n");
+        return false;
+    }
+    stageBegin(STAGE_READBACK);
+    distanceField->read(dst);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, intermediateFBO);
+    stageEnd(STAGE_READBACK);
+    return true;
+}
+
+unsigned int Render::getColorOutputTexture() {
+    if (isDistortionEnable) return isRenderGrayImage ? distortGrayTexture : distortScreenTexture;
+    return isRenderGrayImage ? grayTexture : screenTexture;
+}
+
+void Render::generateImage(const char* outputpath) {
+    int channels = getImageChannels();
+    // sized for the full frame once, so smaller rois do not reallocate either
+    if (imageBuffer.empty()) imageBuffer.resize((size_t)SCR_WIDTH * SCR_HEIGHT * 3);
+    readImage(imageBuffer.data());
+    stageBegin(STAGE_ENCODE);
+    stbi_flip_vertically_on_write(true);
+    stbi_write_png(outputpath, roi.width, roi.height, channels, imageBuffer.data(), channels * roi.width);
+    stageEnd(STAGE_ENCODE);
+}
+
+bool Render::readImage(unsigned char* dst) {
+    if (!dst) return false;
+    stageBegin(STAGE_READBACK);
+    readOutput(GL_COLOR_ATTACHMENT0, isRenderGrayImage ? GL_RED : GL_RGB, GL_UNSIGNED_BYTE, dst);
+    stageEnd(STAGE_READBACK);
+    return true;
+}
+
+bool Render::readPos(float* dst) {
+    if (!dst) return false;
+    enablePos();
+    stageBegin(STAGE_READBACK);
+    readOutput(GL_COLOR_ATTACHMENT1, GL_RGB, GL_FLOAT, dst);
+    stageEnd(STAGE_READBACK);
+    return true;
+}
+
+bool Render::generateTiledImage(CameraPara full, const char* outputpath) {
+    int fullWidth = (int)full.width, fullHeight = (int)full.height;
+    int channels = isRenderGrayImage ? 1 : 3;
+    Camera fullCamera(full);
+    fullCamera.setViewMatrix(camera->getViewMatrix());
+    // the distortion map of a tile's camera is the full image's map cut to the tile, but samples beyond the tile's edges
+    // are missing. so tiles are drawn with the margin a pixel can move by around them, and only their inside is kept
+    int margin = 0;
+    if (isDistortionEnable) {
+        margin = (int)std::ceil(fullCamera.getMaxDistortionShift()) + 2;
+        if (fullWidth < SCR_WIDTH || fullHeight < SCR_HEIGHT || 2 * margin >= SCR_WIDTH || 2 * margin >= SCR_HEIGHT) {
+            printf("distorted tiles need an image at least as large as the Render and a lens shift (%d pixels) below half of it\n", margin);
+            return false;
+        }
+    }
+    RowWriter* writer = createRowWriter(outputpath);
+    if (!writer->open(outputpath, fullWidth, fullHeight, channels)) {
+        delete writer;
+        return false;
+    }
+    CameraPara tileC = camera->getCameraPara();
+    int stepWidth = SCR_WIDTH - 2 * margin, stepHeight = SCR_HEIGHT - 2 * margin;
+    std::vector<GLubyte> tile((size_t)SCR_WIDTH * SCR_HEIGHT * channels);
+    std::vector<GLubyte> band((size_t)fullWidth * stepHeight * channels);
+
+    // bands of tiles from the top of the image down, that is the order the rows are written in
+    for (int top = fullHeight; top > 0; top -= stepHeight) {
+        int rows = std::min(top, stepHeight);
+        // the window drawn for the band, its rows start `margin` below. without distortion the last one may reach below
+        // the image, those rows are simply dropped. distorted windows stay inside the image, which leaves the samples
+        // from outside of it black as in draw()
+        int y = top - stepHeight - margin;
+        if (margin) y = std::min(std::max(y, 0), fullHeight - SCR_HEIGHT);
+        for (int tileX = 0; tileX < fullWidth; tileX += stepWidth) {
+            int cols = std::min(fullWidth - tileX, stepWidth);
+            int x = tileX - margin;
+            if (margin) x = std::min(std::max(x, 0), fullWidth - SCR_WIDTH);
+            camera->setCameraPara(fullCamera.getSubPara(x, y, SCR_WIDTH, SCR_HEIGHT));
+            bgRect = Eigen::Vector4f((float)x / fullWidth, (float)y / fullHeight, (float)SCR_WIDTH / fullWidth, (float)SCR_HEIGHT / fullHeight);
+            setMSAAStatus(isMSAAEnable);
+            draw();
+            stageBegin(STAGE_READBACK);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glBindTexture(GL_TEXTURE_2D, getColorOutputTexture());
+            glGetTexImage(GL_TEXTURE_2D, 0, isRenderGrayImage ? GL_RED : GL_RGB, GL_UNSIGNED_BYTE, tile.data());
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            stageEnd(STAGE_READBACK);
+            // tile rows are bottom-up, band rows top-down
+            for (int r = 0; r < rows; r++) {
+                size_t tileRow = (size_t)(top - 1 - r - y);
+                memcpy(&band[((size_t)r * fullWidth + tileX) * channels], &tile[(tileRow * SCR_WIDTH + tileX - x) * channels], (size_t)cols * channels);
+            }
+        }
+        stageBegin(STAGE_ENCODE);
+        writer->writeRows(band.data(), rows);
+        stageEnd(STAGE_ENCODE);
+    }
+    camera->setCameraPara(tileC);
+    bgRect = Eigen::Vector4f(0, 0, 1, 1);
+    bool ok = writer->close();
+    delete writer;
+    return ok;
+}
+
+const float* Render::getDepthInfo() {
+    if (!pPos) pPos = new float[(long)SCR_HEIGHT * SCR_WIDTH * 3];
+    if (!readPos(pPos)) return NULL;
     //for (int i = 0; i < SCR_HEIGHT * SCR_WIDTH; i++) {
     //    if (pPos[3 * i] < -100) {
     //        cout << pPos[3 * i] << " " << pPos[3 * i + 1] << " " << pPos[3 * i + 2] << " " << endl;
     //    }
     //}
+    return pPos;
+}
+
+void Render::readOutput(GLenum attachment, GLenum format, GLenum type, void* dst) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, getOutputFBO());
+    glReadBuffer(attachment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, roi.width, roi.height, format, type, dst);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, isMSAAEnable ? framebuffer : intermediateFBO);
 }
 
 void Render::setbgRenderStatus(bool status) {
-    if (status && bgImagePath.empty()) {
-        printf("use setbgImage() before activate bgRender\n");
+    if (status && bgImagePath.empty() && !bgStreamer) {
+        printf("use setbgImage() or setbgSource() before activate bgRender\n");
         return;
     }
     isRenderBackGround = status;
@@ -335,19 +1387,41 @@ void Render::setC(Camera* c) {
         throw "ͼߴ粻ͬʱҪͬRender";
     }
     camera = c;
+    wingCache.isValid = false;
 }
 
 void Render::setGrayRenderStatus(bool status) {
     if (status == isRenderGrayImage) return;
     isRenderGrayImage = status;
-    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-    if (isRenderGrayImage) {
-        glBindTexture(GL_TEXTURE_2D, grayTexture);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, grayTexture, 0);
-    }
-    else {
-        glBindTexture(GL_TEXTURE_2D, screenTexture);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenTexture, 0);
+    wingCache.isValid = false;
+    // the color or gray target of the new mode is attached there, the other one released
+    setMSAAStatus(isMSAAEnable);
+}
+
+void Render::setPosRenderStatus(bool status) {
+    if (status == isPosEnable) return;
+    isPosEnable = status;
+    // layer caches made before get or lose their pos layer, a new one is empty so they are filled again
+    LayerCache* caches[] = { &wingCache, &bgCache[0], &bgCache[1] };
+    for (LayerCache* cache : caches) {
+        if (!cache->fbo) continue;
+        glBindFramebuffer(GL_FRAMEBUFFER, cache->fbo);
+        if (!isPosEnable) {
+            deleteTexture(cache->posTexture);
+            continue;
+        }
+        cache->posTexture = createTarget(GL_COLOR_ATTACHMENT1, GL_RGB32F, GL_RGB, GL_FLOAT, GL_NEAREST);
+        cache->isValid = false;
     }
     setMSAAStatus(isMSAAEnable);
+}
+
+// for the readers of pos while it is off: the last draw is repeated with pos on, and in incremental mode the cached
+// layers are made again, as they have no pos layer yet
+void Render::enablePos() {
+    if (isPosEnable) return;
+    bool isIncremental = wingCache.isValid;
+    setPosRenderStatus(true);
+    if (isIncremental) beginIncremental();
+    else draw(roi);
 }
\ No newline at end of file
@@ -0,0 +1,241 @@
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include "render.h"
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+struct RenderCacheDesc {
+    // lookups that round to the same multiples of these steps share an entry. two poses closer than a step can still fall
+    // into neighbouring cells, the steps bound how far apart poses sharing an entry can be, not the other way round
+    float translationStep = 0.01f;      // tx, ty, tz and the translation of the view matrix, model units
+    float rotationStep = 1e-4f;         // rx, ry, rz in radians, scale and the rotation of the view matrix
+    float gStep = 1e-3f;
+    // entries are evicted least recently used first once they take more than this
+    size_t memoryBudget = (size_t)256 << 20;
+    // what a miss keeps of the draw
+    bool isStoreImage = true;
+    bool isStoreMask = false;           // coverage from pos, 255 where a model was drawn
+    // image and mask are averaged over downsample x downsample blocks, 1 keeps them at full size
+    int downsample = 1;
+    // called after the draw of a miss while its outputs are still in the Render (chamferScore, computeDistanceField, ...),
+    // fills the scores kept with the entry
+    std::function<void(Render&, std::vector<float>&)> scorer;
+};
+
+// what a draw left behind, rows bottom-up like the outputs of Render
+struct RenderCacheEntry {
+    RenderROI roi;
+    int width = 0;                      // of image and mask, the roi divided by downsample and rounded up
+    int height = 0;
+    int channels = 0;
+    std::vector<unsigned char> image;
+    std::vector<unsigned char> mask;
+    std::vector<float> scores;
+
+    size_t bytes() const { return sizeof(*this) + image.capacity() + mask.capacity() + scores.capacity() * sizeof(float); }
+};
+
+struct RenderCacheStats {
+    long long hits = 0;
+    long long misses = 0;
+    long long evictions = 0;
+    int entries = 0;
+    size_t bytes = 0;
+
+    double hitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0; }
+};
+
+// results of a Render by pose, G, camera, models and mode, so that an optimizer coming back to (almost) the same pose gets
+// its image, mask and scores without a draw or readback. the key quantises pose, G and view matrix by the steps of the
+// desc and takes the intrinsics, roi, model and scene generations and getModeFlags() exactly. the background image is not
+// part of the key, clear() the cache when it changes.
+class RenderCache {
+public:
+    RenderCache(Render* render, RenderCacheDesc d = RenderCacheDesc()) : render(render), desc(d) {
+        if (desc.downsample < 1) desc.downsample = 1;
+    }
+
+    // the entry of pose and G with the Render's current camera, models and mode, drawn on a miss (which leaves the Render at
+    // pose and G). an empty roi draws the full frame. the pointer is valid until the next get() or clear(), NULL when the
+    // draw or readback of a miss failed, nothing is cached then
+    const RenderCacheEntry* get(const ModelTransformDesc& pose, float G, RenderROI roi = RenderROI()) {
+        Key key = makeKey(pose, G, roi);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            stats.hits++;
+            lru.splice(lru.begin(), lru, it->second);
+            return &it->second->entry;
+        }
+        stats.misses++;
+        lru.emplace_front();
+        Node& node = lru.front();
+        node.key = key;
+        if (!fill(node.entry, pose, G, roi)) {
+            lru.pop_front();
+            return NULL;
+        }
+        node.bytes = node.entry.bytes() + key.size() * sizeof(long long) * 2;
+        entries[key] = lru.begin();
+        stats.bytes += node.bytes;
+        // the newest entry stays even when it alone is over budget
+        while (stats.bytes > desc.memoryBudget && lru.size() > 1) {
+            stats.bytes -= lru.back().bytes;
+            entries.erase(lru.back().key);
+            lru.pop_back();
+            stats.evictions++;
+        }
+        stats.entries = (int)lru.size();
+        return &node.entry;
+    }
+
+    void clear() {
+        entries.clear();
+        lru.clear();
+        stats.bytes = 0;
+        stats.entries = 0;
+    }
+
+    RenderCacheStats getStats() { return stats; }
+    void resetStats() {
+        stats.hits = stats.misses = stats.evictions = 0;
+    }
+
+private:
+    typedef std::vector<long long> Key;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            // FNV-1a, like the program cache
+            unsigned long long h = 14695981039346656037ull;
+            for (long long v : key) {
+                for (int b = 0; b < 8; b++) {
+                    h ^= (unsigned long long)(v >> (b * 8)) & 0xff;
+                    h *= 1099511628211ull;
+                }
+            }
+            return (size_t)h;
+        }
+    };
+
+    struct Node {
+        Key key;
+        RenderCacheEntry entry;
+        size_t bytes = 0;
+    };
+
+    Render* render;
+    RenderCacheDesc desc;
+    std::list<Node> lru;                // most recently used first
+    std::unordered_map<Key, std::list<Node>::iterator, KeyHash> entries;
+    RenderCacheStats stats;
+    std::vector<unsigned char> image;   // readback of a miss, kept between misses
+    std::vector<float> pos;
+
+    static long long quantise(float v, float step) { return step > 0 ? (long long)std::llround(v / step) : bits(v); }
+
+    static long long bits(float v) {
+        unsigned int u;
+        memcpy(&u, &v, sizeof(u));
+        return u;
+    }
+
+    Key makeKey(const ModelTransformDesc& pose, float G, const RenderROI& roi) {
+        Key key;
+        key.reserve(48);
+        key.push_back(quantise(pose.tx, desc.translationStep));
+        key.push_back(quantise(pose.ty, desc.translationStep));
+        key.push_back(quantise(pose.tz, desc.translationStep));
+        key.push_back(quantise(pose.rx, desc.rotationStep));
+        key.push_back(quantise(pose.ry, desc.rotationStep));
+        key.push_back(quantise(pose.rz, desc.rotationStep));
+        key.push_back(quantise(pose.scale, desc.rotationStep));
+        key.push_back(quantise(G, desc.gStep));
+        Camera* camera = render->getCamera();
+        const M4f& view = camera->getViewMatrix();
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++) key.push_back(quantise(view(row, col), desc.rotationStep));
+            key.push_back(quantise(view(row, 3), desc.translationStep));
+        }
+        CameraPara C = camera->getCameraPara();
+        const float intrinsics[] = { C.width, C.height, C.f, C.dx, C.dy, C.x0, C.y0, C.zNear, C.zFar, C.k1, C.k2, C.p1, C.p2, C.k3 };
+        for (float v : intrinsics) key.push_back(bits(v));
+        key.push_back(roi.x);
+        key.push_back(roi.y);
+        key.push_back(roi.width);
+        key.push_back(roi.height);
+        key.push_back(render->getModeFlags());
+        // generations rather than addresses, a model freed and another one created at its address must not hit, nor a
+        // wing bent again in place
+        Model* body = render->getBodyModel();
+        Model* wing = render->getWingModel();
+        Scene* scene = render->getScene();
+        key.push_back(body ? (long long)body->generation : 0);
+        key.push_back(wing ? (long long)wing->generation : 0);
+        key.push_back(scene ? (long long)scene->getGeneration() : 0);
+        return key;
+    }
+
+    bool fill(RenderCacheEntry& entry, const ModelTransformDesc& pose, float G, const RenderROI& roi) {
+        ModelTransformDesc d = pose;
+        render->setModelTransform(&d);
+        render->setWingG(G);
+        // the mask comes from pos, on before the draw so that readPos does not draw again
+        if (desc.isStoreMask) render->setPosRenderStatus(true);
+        // a rejected roi leaves the outputs of the previous draw, which must not be cached under this key
+        bool isDrawn = roi.width > 0 && roi.height > 0 ? render->draw(roi) : render->draw();
+        if (!isDrawn) return false;
+        entry.roi = render->getROI();
+        int w = entry.roi.width, h = entry.roi.height, n = desc.downsample;
+        entry.width = (w + n - 1) / n;
+        entry.height = (h + n - 1) / n;
+        entry.channels = render->getImageChannels();
+        if (desc.isStoreImage) {
+            image.resize((size_t)w * h * entry.channels);
+            if (!render->readImage(image.data())) return false;
+            entry.image.resize((size_t)entry.width * entry.height * entry.channels);
+            downsample(image.data(), w, h, entry.channels, entry.image.data());
+        }
+        if (desc.isStoreMask) {
+            pos.resize((size_t)w * h * 3);
+            if (!render->readPos(pos.data())) return false;
+            // pos is 1e6 wherever nothing was drawn
+            image.resize((size_t)w * h);
+            for (size_t i = 0; i < (size_t)w * h; i++) image[i] = pos[i * 3] < 1e5f ? 255 : 0;
+            entry.mask.resize((size_t)entry.width * entry.height);
+            downsample(image.data(), w, h, 1, entry.mask.data());
+        }
+        if (desc.scorer) desc.scorer(*render, entry.scores);
+        return true;
+    }
+
+    // block average, the blocks at the right and top edge are averaged over the pixels they have
+    void downsample(const unsigned char* src, int w, int h, int channels, unsigned char* dst) {
+        int n = desc.downsample;
+        if (n == 1) {
+            memcpy(dst, src, (size_t)w * h * channels);
+            return;
+        }
+        int dw = (w + n - 1) / n, dh = (h + n - 1) / n;
+        for (int by = 0; by < dh; by++) {
+            for (int bx = 0; bx < dw; bx++) {
+                for (int c = 0; c < channels; c++) {
+                    unsigned int sum = 0, count = 0;
+                    for (int y = by * n; y < std::min(h, by * n + n); y++) {
+                        for (int x = bx * n; x < std::min(w, bx * n + n); x++) {
+                            sum += src[((size_t)y * w + x) * channels + c];
+                            count++;
+                        }
+                    }
+                    dst[((size_t)by * dw + bx) * channels + c] = (unsigned char)((sum + count / 2) / count);
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef RENDERCLIENT_H
+#define RENDERCLIENT_H
+
+// client of renderserver, needs no GL. POSIX only (Unix domain socket and shm_open), link with -lrt on older glibc.
+//
+//   RenderClient client;
+//   client.connect("/tmp/rendermodel.sock");
+//   for (...) client.send(request);        // pipelined, up to getSlotCount() in flight
+//   RenderResult r; client.receive(r);     // r.gray etc. point into shared memory, nothing is copied
+
+#ifndef _WIN32
+#include "renderprotocol.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+struct RenderResult {
+    RenderResponse response;
+    int width = 0;
+    int height = 0;
+    // NULL for outputs that were not requested
+    const unsigned char* color = NULL;
+    const unsigned char* gray = NULL;
+    const float* pos = NULL;
+};
+
+class RenderClient {
+public:
+    ~RenderClient() { close(); }
+
+    bool connect(std::string const& socketPath) {
+        close();
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        if (fd < 0 || ::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            printf("can not connect to %s\n", socketPath.c_str());
+            close();
+            return false;
+        }
+        if (!readAll(&hello, sizeof(hello)) || hello.version != RENDER_PROTOCOL_VERSION) {
+            printf("render server speaks another protocol version\n");
+            close();
+            return false;
+        }
+        int shm = shm_open(hello.shmName, O_RDONLY, 0);
+        if (shm < 0) {
+            printf("can not open shared memory %s\n", hello.shmName);
+            close();
+            return false;
+        }
+        mappedBytes = (size_t)(hello.slotBytes * hello.slotCount);
+        void* p = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, shm, 0);
+        ::close(shm);
+        if (p == MAP_FAILED) {
+            printf("can not map shared memory %s\n", hello.shmName);
+            close();
+            return false;
+        }
+        mapped = (const unsigned char*)p;
+        sent = received = 0;
+        return true;
+    }
+
+    int getWidth() { return hello.width; }
+    int getHeight() { return hello.height; }
+    int getSlotCount() { return (int)hello.slotCount; }
+    // requests sent but not received yet
+    int getInFlight() { return (int)(sent - received); }
+
+    // queue a request without waiting for its result. fails when getSlotCount() requests are unanswered,
+    // receive() one first: the next request would overwrite a slot whose response has not been read
+    bool send(const RenderRequest& request) {
+        if (fd < 0) return false;
+        if (sent - received >= hello.slotCount) {
+            printf("%u requests in flight already, receive() first\n", hello.slotCount);
+            return false;
+        }
+        if (!writeAll(&request, sizeof(request))) return false;
+        sent++;
+        return true;
+    }
+
+    // blocks for the next response, in request order. the pointers stay valid until getSlotCount() more requests are sent
+    bool receive(RenderResult& result) {
+        if (fd < 0 || received == sent) return false;
+        if (!readAll(&result.response, sizeof(RenderResponse))) return false;
+        received++;
+        const RenderResponse& r = result.response;
+        const unsigned char* slot = mapped + r.slot * hello.slotBytes;
+        result.width = hello.width;
+        result.height = hello.height;
+        result.color = r.outputs & RENDER_OUTPUT_COLOR ? slot + r.colorOffset : NULL;
+        result.gray = r.outputs & RENDER_OUTPUT_GRAY ? slot + r.grayOffset : NULL;
+        result.pos = r.outputs & RENDER_OUTPUT_POS ? (const float*)(slot + r.posOffset) : NULL;
+        return r.status == 0;
+    }
+
+    // asks the server to exit once the requests sent so far are answered, receive() them first. the connection is closed
+    bool shutdownServer() {
+        if (fd < 0) return false;
+        RenderRequest request{};
+        request.outputs = RENDER_REQUEST_SHUTDOWN;
+        bool ok = writeAll(&request, sizeof(request));
+        close();
+        return ok;
+    }
+
+    void close() {
+        if (mapped) munmap((void*)mapped, mappedBytes);
+        if (fd >= 0) ::close(fd);
+        mapped = NULL;
+        fd = -1;
+    }
+
+private:
+    int fd = -1;
+    RenderHello hello;
+    const unsigned char* mapped = NULL;
+    size_t mappedBytes = 0;
+    unsigned long long sent = 0;
+    unsigned long long received = 0;
+
+    bool readAll(void* dst, size_t bytes) {
+        char* p = (char*)dst;
+        while (bytes) {
+            ssize_t n = read(fd, p, bytes);
+            if (n <= 0) return false;
+            p += n;
+            bytes -= n;
+        }
+        return true;
+    }
+
+    bool writeAll(const void* src, size_t bytes) {
+        const char* p = (const char*)src;
+        while (bytes) {
+            ssize_t n = write(fd, p, bytes);
+            if (n <= 0) return false;
+            p += n;
+            bytes -= n;
+        }
+        return true;
+    }
+};
+
+#endif
+#endif
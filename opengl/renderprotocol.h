@@ -0,0 +1,66 @@
+#ifndef RENDERPROTOCOL_H
+#define RENDERPROTOCOL_H
+
+// messages between renderserver and RenderClient. both ends run on the same machine, so the structs go over the
+// socket as they are. images never go over the socket: they are written into a shared memory segment that the
+// client maps once, a response only says where.
+//
+// connect -> server sends RenderHello
+// client sends any number of RenderRequest (at most slotCount unanswered), server answers each with a RenderResponse
+// in the same order. the images of a response are in slot `slot` of the segment and stay there until slotCount more
+// requests have been sent. a request with RENDER_REQUEST_SHUTDOWN in outputs is not answered: the server finishes the
+// requests before it, closes the connection and exits.
+
+const unsigned int RENDER_PROTOCOL_VERSION = 1;
+
+enum RenderOutput {
+    RENDER_OUTPUT_COLOR = 1,    // RGB8
+    RENDER_OUTPUT_GRAY = 2,     // R8
+    RENDER_OUTPUT_POS = 4,      // RGB32F model space position, 1e6 where nothing was drawn
+};
+
+// not an output: stops the server, see above
+const unsigned int RENDER_REQUEST_SHUTDOWN = 1u << 31;
+
+struct RenderHello {
+    unsigned int version;
+    int width;
+    int height;
+    unsigned int slotCount;
+    unsigned long long slotBytes;
+    char shmName[64];           // for shm_open
+};
+
+struct RenderRequest {
+    unsigned int id;            // echoed in the response
+    unsigned int outputs;       // RenderOutput bits
+    float viewMatrix[16];       // column major, like Eigen and GL
+    // ModelTransformDesc of the models
+    float tx = 0, ty = 0, tz = 0, rx = 0, ry = 0, rz = 0, scale = 1;
+    float G = 0;
+    // when set, replaces the intrinsics of the server camera. width and height are fixed by the server
+    int hasIntrinsics = 0;
+    float f, dx, dy, x0, y0;
+    float zNear = 100, zFar = 10000;
+    float k1 = 0, k2 = 0, p1 = 0, p2 = 0, k3 = 0;
+};
+
+struct RenderResponse {
+    unsigned int id;
+    int status;                 // 0 ok, otherwise nothing was rendered
+    unsigned int slot;
+    unsigned int outputs;       // outputs that were written
+    // byte offsets from the start of the segment, rows bottom-up like GL, tightly packed
+    unsigned long long colorOffset;
+    unsigned long long grayOffset;
+    unsigned long long posOffset;
+};
+
+// layout of one slot: color, gray, pos, each starting on a 64 byte boundary
+inline unsigned long long renderSlotAlign(unsigned long long n) { return (n + 63) & ~63ull; }
+inline unsigned long long renderSlotColorOffset() { return 0; }
+inline unsigned long long renderSlotGrayOffset(int width, int height) { return renderSlotAlign((unsigned long long)width * height * 3); }
+inline unsigned long long renderSlotPosOffset(int width, int height) { return renderSlotGrayOffset(width, height) + renderSlotAlign((unsigned long long)width * height); }
+inline unsigned long long renderSlotBytes(int width, int height) { return renderSlotPosOffset(width, height) + renderSlotAlign((unsigned long long)width * height * 12); }
+
+#endif
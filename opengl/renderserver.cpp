@@ -0,0 +1,330 @@
+// long running render service: the GL context, models, programs and render targets are created once, then requests
+// come in over a Unix domain socket and results go out through shared memory (see renderprotocol.h, renderclient.h).
+// separate executable, build it from this file and glad.c instead of kernel.cpp. POSIX only.
+//
+//   renderserver --body model/body.obj [--wing model/wing.obj] [--width 1920] [--height 1440]
+//                [--socket /tmp/rendermodel.sock] [--slots 4] [--software]
+//
+// clients are served one after another. the requests of a client are pipelined: while request n is drawn, the
+// readback of request n-1 is still on its way through a pixel buffer and is only copied out once n has been issued.
+// every request is drawn once: in gray mode when gray is all it asks for, otherwise in color, with gray converted from
+// the color on the CPU, so that asking for both does not switch the targets of the Render back and forth.
+// the server exits on SIGINT, SIGTERM or a RENDER_REQUEST_SHUTDOWN request (RenderClient::shutdownServer()).
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define _CRT_SECURE_NO_WARNINGS
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <Eigen/Dense>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "stb_image_write.h"
+#include "shader.h"
+#include "model.h"
+#include "camera.h"
+#include "render.h"
+#include "glcontext.h"
+#include "renderprotocol.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// set by SIGINT and SIGTERM, which also interrupt a blocking accept() or read()
+static volatile sig_atomic_t isStopping = 0;
+
+static void onStopSignal(int) { isStopping = 1; }
+
+static bool readAll(int fd, void* dst, size_t bytes) {
+    char* p = (char*)dst;
+    while (bytes) {
+        ssize_t n = read(fd, p, bytes);
+        if (n <= 0) return false;
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void* src, size_t bytes) {
+    const char* p = (const char*)src;
+    while (bytes) {
+        ssize_t n = write(fd, p, bytes);
+        if (n <= 0) return false;
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+class RenderServer {
+public:
+    RenderServer(Render& render, Camera& camera, int slotCount) : render(render), camera(camera), slotCount(slotCount) {
+        width = camera.getWidth();
+        height = camera.getHeight();
+        slotBytes = renderSlotBytes(width, height);
+        glGenBuffers(2, pbo);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, slotBytes, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // the context must still be current
+    ~RenderServer() {
+        glDeleteBuffers(2, pbo);
+    }
+
+    void serve(int client) {
+        std::string shmName = "/rendermodel_" + std::to_string((long long)getpid()) + "_" + std::to_string(clientCount++);
+        int shm = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (shm < 0 || ftruncate(shm, (off_t)(slotBytes * slotCount)) != 0) {
+            printf("can not create shared memory %s\n", shmName.c_str());
+            if (shm >= 0) ::close(shm);
+            return;
+        }
+        void* p = mmap(NULL, slotBytes * slotCount, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+        ::close(shm);
+        if (p == MAP_FAILED) {
+            printf("can not map shared memory %s\n", shmName.c_str());
+            shm_unlink(shmName.c_str());
+            return;
+        }
+        slots = (unsigned char*)p;
+
+        RenderHello hello;
+        memset(&hello, 0, sizeof(hello));
+        hello.version = RENDER_PROTOCOL_VERSION;
+        hello.width = width;
+        hello.height = height;
+        hello.slotCount = slotCount;
+        hello.slotBytes = slotBytes;
+        strncpy(hello.shmName, shmName.c_str(), sizeof(hello.shmName) - 1);
+        bool ok = writeAll(client, &hello, sizeof(hello));
+
+        RenderRequest request;
+        unsigned long long served = 0;
+        pending.isActive = false;
+        while (ok) {
+            // nothing else queued: finish the pending request now instead of leaving it waiting for the next one
+            if (pending.isActive) {
+                pollfd pfd = { client, POLLIN, 0 };
+                if (poll(&pfd, 1, 0) == 0) ok = finish(client);
+            }
+            if (!ok || !readAll(client, &request, sizeof(request))) break;
+            if (request.outputs & RENDER_REQUEST_SHUTDOWN) {
+                isStopping = 1;
+                break;
+            }
+            unsigned int slot = (unsigned int)(served++ % slotCount);
+            int next = pending.isActive ? 1 - pending.pboIndex : 0;
+            Pending current;
+            current.response = drawRequest(request, slot, pbo[next], current.isGrayFromColor);
+            current.pboIndex = next;
+            current.isActive = true;
+            // the previous readback had the whole draw above to complete
+            if (pending.isActive) ok = finish(client);
+            pending = current;
+        }
+        if (ok && pending.isActive) finish(client);
+        pending.isActive = false;
+        munmap(slots, slotBytes * slotCount);
+        shm_unlink(shmName.c_str());
+    }
+
+private:
+    struct Pending {
+        RenderResponse response;
+        int pboIndex = 0;
+        bool isGrayFromColor = false;
+        bool isActive = false;
+    };
+
+    Render& render;
+    Camera& camera;
+    int width, height;
+    unsigned int slotCount;
+    unsigned long long slotBytes;
+    unsigned int pbo[2];
+    unsigned char* slots = NULL;
+    Pending pending;
+    int clientCount = 0;
+
+    // draws every requested output and starts its readback into buf, laid out like a slot. isGrayFromColor is set when
+    // gray has to be converted from the color in finish()
+    RenderResponse drawRequest(const RenderRequest& q, unsigned int slot, unsigned int buf, bool& isGrayFromColor) {
+        RenderResponse r;
+        memset(&r, 0, sizeof(r));
+        r.id = q.id;
+        r.slot = slot;
+        r.colorOffset = renderSlotColorOffset();
+        r.grayOffset = renderSlotGrayOffset(width, height);
+        r.posOffset = renderSlotPosOffset(width, height);
+
+        camera.setViewMatrix(Eigen::Map<const M4f>(q.viewMatrix));
+        if (q.hasIntrinsics) {
+            CameraPara C = camera.getCameraPara();
+            C.f = q.f; C.dx = q.dx; C.dy = q.dy; C.x0 = q.x0; C.y0 = q.y0; C.zNear = q.zNear; C.zFar = q.zFar;
+            C.k1 = q.k1; C.k2 = q.k2; C.p1 = q.p1; C.p2 = q.p2; C.k3 = q.k3;
+            camera.setCameraPara(C);
+            render.setDistortionStatus(camera.hasDistortion());
+        }
+        ModelTransformDesc td;
+        td.tx = q.tx; td.ty = q.ty; td.tz = q.tz; td.rx = q.rx; td.ry = q.ry; td.rz = q.rz; td.scale = q.scale;
+        render.setModelTransform(&td);
+        render.setWingG(q.G);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buf);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        bool needGray = (q.outputs & RENDER_OUTPUT_GRAY) != 0;
+        bool needColor = (q.outputs & RENDER_OUTPUT_COLOR) != 0;
+        bool needPos = (q.outputs & RENDER_OUTPUT_POS) != 0;
+        bool isGrayDraw = needGray && !needColor;
+        isGrayFromColor = needGray && needColor;
+        // the pos target only exists while a request asks for it
+        render.setPosRenderStatus(needPos);
+        render.setGrayRenderStatus(isGrayDraw);
+        render.setMSAAStatus(false);
+        render.draw();
+        if (isGrayDraw) readTexture(render.getGrayTexture(), GL_RED, GL_UNSIGNED_BYTE, r.grayOffset);
+        else if (needColor) readTexture(render.getScreenTexture(), GL_RGB, GL_UNSIGNED_BYTE, r.colorOffset);
+        if (needPos) readTexture(render.getPosTexture(), GL_RGB, GL_FLOAT, r.posOffset);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        r.outputs = q.outputs & (RENDER_OUTPUT_COLOR | RENDER_OUTPUT_GRAY | RENDER_OUTPUT_POS);
+        return r;
+    }
+
+    // with a pack buffer bound the pointer argument is an offset into it, the call returns without waiting
+    void readTexture(unsigned int texture, GLenum format, GLenum type, unsigned long long offset) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexImage(GL_TEXTURE_2D, 0, format, type, (void*)(size_t)offset);
+    }
+
+    // copies the finished readback of the pending request into its slot and answers it
+    bool finish(int client) {
+        RenderResponse& r = pending.response;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[pending.pboIndex]);
+        const unsigned char* src = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slotBytes, GL_MAP_READ_BIT);
+        unsigned char* dst = slots + r.slot * slotBytes;
+        size_t pixels = (size_t)width * height;
+        if (src) {
+            if (r.outputs & RENDER_OUTPUT_COLOR) memcpy(dst + r.colorOffset, src + r.colorOffset, pixels * 3);
+            if ((r.outputs & RENDER_OUTPUT_GRAY) && pending.isGrayFromColor) {
+                // the weights of objectShader_gray.fs
+                const unsigned char* color = src + r.colorOffset;
+                unsigned char* gray = dst + r.grayOffset;
+                for (size_t i = 0; i < pixels; i++)
+                    gray[i] = (unsigned char)(color[i * 3] * 0.299f + color[i * 3 + 1] * 0.587f + color[i * 3 + 2] * 0.114f + 0.5f);
+            }
+            else if (r.outputs & RENDER_OUTPUT_GRAY) memcpy(dst + r.grayOffset, src + r.grayOffset, pixels);
+            if (r.outputs & RENDER_OUTPUT_POS) memcpy(dst + r.posOffset, src + r.posOffset, pixels * 12);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        else {
+            r.status = -1;
+            r.outputs = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pending.isActive = false;
+        return writeAll(client, &r, sizeof(r));
+    }
+};
+
+int main(int argc, char** argv) {
+    std::string socketPath = "/tmp/rendermodel.sock";
+    std::string bodyPath, wingPath;
+    int width = 1920, height = 1440, slotCount = 4;
+    bool isSoftware = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--socket") && i + 1 < argc) socketPath = argv[++i];
+        else if (!strcmp(argv[i], "--body") && i + 1 < argc) bodyPath = argv[++i];
+        else if (!strcmp(argv[i], "--wing") && i + 1 < argc) wingPath = argv[++i];
+        else if (!strcmp(argv[i], "--width") && i + 1 < argc) width = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--height") && i + 1 < argc) height = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--slots") && i + 1 < argc) slotCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--software")) isSoftware = true;
+        else {
+            printf("usage: %s --body body.obj [--wing wing.obj] [--width 1920] [--height 1440] [--socket path] [--slots 4] [--software]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (bodyPath.empty() && wingPath.empty()) {
+        printf("at least one of --body and --wing is needed\n");
+        return -1;
+    }
+    if (slotCount < 1) slotCount = 1;
+    // a client that went away must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    // without SA_RESTART, so a blocked accept() returns and the loop below ends
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = onStopSignal;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    GLFWwindow* window = createGLContext(width, height, true, isSoftware);
+    CameraPara C;
+    C.width = (float)width; C.height = (float)height; C.dx = 5e-6f; C.dy = 5e-6f; C.f = 0.6125f; C.x0 = C.width / 2; C.y0 = C.height / 2;
+    Camera camera(C);
+    // the wing is loaded undeformed, the load G of each request is applied by the wing shader
+    Model* body = bodyPath.empty() ? NULL : new Model(bodyPath);
+    Model* wing = wingPath.empty() ? NULL : new Model(wingPath);
+    ModelTransformDesc td;
+    RenderDesc desc;
+    desc.camera = &camera;
+    desc.bodyModel = body;
+    desc.wingModel = wing;
+    desc.tranDesc = &td;
+    int status = 0;
+    {
+        // the Render and the server free their GL objects when this scope closes, before the context goes away
+        Render render(desc);
+        RenderServer server(render, camera, slotCount);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socketPath.c_str());
+        if (listener < 0 || bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 8) != 0) {
+            printf("can not listen on %s\n", socketPath.c_str());
+            if (listener >= 0) close(listener);
+            status = -1;
+        }
+        else {
+            printf("rendering %dx%d on %s\n", width, height, socketPath.c_str());
+            while (!isStopping) {
+                int client = accept(listener, NULL, NULL);
+                if (client < 0) continue;
+                server.serve(client);
+                close(client);
+            }
+            printf("shutting down\n");
+            close(listener);
+            unlink(socketPath.c_str());
+        }
+    }
+    ProgramCache::instance().release();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return status;
+}
+
+#else
+#include <cstdio>
+
+int main() {
+    printf("renderserver needs Unix domain sockets and POSIX shared memory\n");
+    return -1;
+}
+#endif
@@ -0,0 +1,227 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+#include "model.h"
+#include "shader.h"
+#include <algorithm>
+#include <vector>
+#include <cstring>
+
+// several models drawn as one: the meshes of every model share one vertex and one index buffer, and the whole scene is a
+// single glDrawElements with sceneShader. what differs per mesh (color, transform of its model, deformation) is looked up
+// in a texture buffer through the drawId vertex attribute. the geometry is copied straight from the models into the GPU
+// buffers, the scene keeps no CPU copy of it.
+// the models keep their own buffers, so each vertex is on the GPU twice (sizeof(Vertex) = 56 bytes, plus 4 for its drawId)
+// and each index too. models only drawn through the scene can give theirs back with Model::release() once added, the
+// scene uploads from the vertices and indices the meshes keep on the CPU.
+class Scene {
+public:
+    // transform is applied before the model matrix of the Render, isDeformed bends the model by the wing load G.
+    // returns the id of the entry for setTransform() and setDeformed()
+    int addModel(Model* model, const M4f& transform = M4f::Identity(), bool isDeformed = false) {
+        SceneEntry e;
+        e.model = model;
+        e.transform = transform;
+        e.isDeformed = isDeformed;
+        entries.push_back(e);
+        isBuilt = false;
+        generation = nextGeneration();
+        return (int)entries.size() - 1;
+    }
+
+    void setTransform(int id, const M4f& transform) {
+        entries[id].transform = transform;
+        isDrawDataDirty = true;
+        generation = nextGeneration();
+    }
+
+    void setDeformed(int id, bool isDeformed) {
+        entries[id].isDeformed = isDeformed;
+        isDrawDataDirty = true;
+        generation = nextGeneration();
+    }
+
+    int modelCount() { return (int)entries.size(); }
+    // changes with addModel(), setTransform(), setDeformed() and the generation of every model in it: generations only
+    // grow, so the largest one is new whenever any of them is
+    unsigned long long getGeneration() {
+        unsigned long long g = generation;
+        for (auto& e : entries) g = std::max(g, e.model->generation);
+        return g;
+    }
+    // meshes of every model, each has its own id in the id output of Render
+    int meshCount() {
+        int n = 0;
+        for (auto& e : entries) n += (int)e.model->meshes.size();
+        return n;
+    }
+
+    // upload the geometry of every model, done by Draw() when models were added since the last build
+    void build() {
+        release();
+        long long vertexCount = 0, indexCount = 0;
+        drawCount = 0;
+        for (auto& e : entries) {
+            for (auto& mesh : e.model->meshes) {
+                vertexCount += mesh.vertices.size();
+                indexCount += mesh.indices.size();
+                drawCount++;
+            }
+        }
+        isBuilt = true;
+        isDrawDataDirty = true;
+        elementCount = (unsigned int)indexCount;
+        if (!vertexCount || !indexCount) return;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &drawIdVBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+        long long offset = 0;
+        for (auto& e : entries) {
+            for (auto& mesh : e.model->meshes) {
+                if (mesh.vertices.empty()) continue;
+                glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(Vertex), mesh.vertices.size() * sizeof(Vertex), &mesh.vertices[0]);
+                offset += mesh.vertices.size();
+            }
+        }
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+
+        // indices are rebased onto the shared vertex buffer and drawIds written while mapping, without a staging copy
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+        unsigned int* ids = (unsigned int*)glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexCount * sizeof(unsigned int), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+        unsigned int* indices = (unsigned int*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        unsigned int drawId = 0, baseVertex = 0;
+        for (auto& e : entries) {
+            for (auto& mesh : e.model->meshes) {
+                for (size_t i = 0; i < mesh.vertices.size(); i++) *ids++ = drawId;
+                for (size_t i = 0; i < mesh.indices.size(); i++) *indices++ = mesh.indices[i] + baseVertex;
+                baseVertex += (unsigned int)mesh.vertices.size();
+                drawId++;
+            }
+        }
+        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+        glBindVertexArray(0);
+
+        glGenBuffers(1, &drawDataBuffer);
+        glGenTextures(1, &drawDataTexture);
+
+        // the first triangle of each draw only changes with the geometry. integers go through their own R32UI buffer,
+        // bits stored in a float texel can be flushed to zero when they form a denormal
+        std::vector<unsigned int> firstTriangles;
+        firstTriangles.reserve(drawCount);
+        unsigned int firstTriangle = 0;
+        for (auto& e : entries) {
+            for (auto& mesh : e.model->meshes) {
+                firstTriangles.push_back(firstTriangle);
+                firstTriangle += (unsigned int)mesh.indices.size() / 3;
+            }
+        }
+        glGenBuffers(1, &firstTriangleBuffer);
+        glGenTextures(1, &firstTriangleTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, firstTriangleBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, firstTriangles.size() * sizeof(unsigned int), firstTriangles.data(), GL_STATIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, firstTriangleTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, firstTriangleBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void Draw(Shader& shader) {
+        if (!isBuilt) build();
+        if (!elementCount) return;
+        if (isDrawDataDirty) updateDrawData();
+        shader.use();
+        shader.setInt("drawData", DRAW_DATA_UNIT);
+        shader.setInt("firstTriangles", FIRST_TRIANGLE_UNIT);
+        glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+        glActiveTexture(GL_TEXTURE0 + FIRST_TRIANGLE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, firstTriangleTexture);
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // frees the GPU buffers, the next Draw() uploads everything again
+    void release() {
+        if (VAO) glDeleteVertexArrays(1, &VAO);
+        unsigned int buffers[] = { VBO, drawIdVBO, EBO, drawDataBuffer, firstTriangleBuffer };
+        for (unsigned int b : buffers) if (b) glDeleteBuffers(1, &b);
+        unsigned int textures[] = { drawDataTexture, firstTriangleTexture };
+        for (unsigned int t : textures) if (t) glDeleteTextures(1, &t);
+        VAO = VBO = drawIdVBO = EBO = drawDataBuffer = drawDataTexture = firstTriangleBuffer = firstTriangleTexture = 0;
+        isBuilt = false;
+    }
+
+private:
+    struct SceneEntry {
+        Model* model;
+        M4f transform;
+        bool isDeformed;
+    };
+    // texture unit of drawData, above the ones the other programs use
+    static const int DRAW_DATA_UNIT = 3;
+    // texture unit of firstTriangles, Render keeps 4 for the wing lut
+    static const int FIRST_TRIANGLE_UNIT = 5;
+    // texels per draw: color, the 4 columns of the transform, flags (x: deformed)
+    static const int DRAW_DATA_TEXELS = 6;
+
+    std::vector<SceneEntry> entries;
+    unsigned long long generation = nextGeneration();
+    bool isBuilt = false;
+    bool isDrawDataDirty = true;
+    unsigned int drawCount = 0;
+    unsigned int elementCount = 0;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int drawIdVBO = 0;
+    unsigned int EBO = 0;
+    unsigned int drawDataBuffer = 0;
+    unsigned int drawDataTexture = 0;
+    unsigned int firstTriangleBuffer = 0;
+    unsigned int firstTriangleTexture = 0;
+
+    void updateDrawData() {
+        std::vector<float> data((size_t)drawCount * DRAW_DATA_TEXELS * 4, 0.0f);
+        float* p = data.data();
+        for (auto& e : entries) {
+            for (auto& mesh : e.model->meshes) {
+                p[0] = mesh.colors.r; p[1] = mesh.colors.g; p[2] = mesh.colors.b; p[3] = mesh.colors.a;
+                memcpy(p + 4, e.transform.data(), 16 * sizeof(float));
+                p[20] = e.isDeformed ? 1.0f : 0.0f;
+                p += DRAW_DATA_TEXELS * 4;
+            }
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(float), data.data(), GL_DYNAMIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        isDrawDataDirty = false;
+    }
+};
+
+#endif
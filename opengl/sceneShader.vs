@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in uint aDrawId;
+
+out vec3 Pos;
+flat out vec4 Color;
+flat out uint DrawId;
+flat out uint FirstTriangle;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 perspective;
+uniform float G;
+// per draw, see Scene: color, the 4 columns of the model transform, flags (x: deformed by G)
+uniform samplerBuffer drawData;
+// per draw: index of its first triangle in the scene
+uniform usamplerBuffer firstTriangles;
+
+// wingOffset() and WING_REFERENCE_G are inserted by WingCalibration::shaderSource(), see wingShader.vs
+
+void main()
+{
+    int base = int(aDrawId) * 6;
+    Color = texelFetch(drawData, base);
+    mat4 transform = mat4(texelFetch(drawData, base + 1), texelFetch(drawData, base + 2),
+                          texelFetch(drawData, base + 3), texelFetch(drawData, base + 4));
+    vec4 flags = texelFetch(drawData, base + 5);
+    DrawId = aDrawId;
+    FirstTriangle = texelFetch(firstTriangles, int(aDrawId)).r;
+
+    vec3 p = aPos;
+    if (flags.x > 0.5) p.z = p.z + wingOffset(aPos) * (G / WING_REFERENCE_G);
+    Pos = (transform * vec4(p, 1.0)).xyz;
+    gl_Position = perspective * view * model * vec4(Pos, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+in vec3 Pos;
+flat in vec4 Color;
+flat in uint DrawId;
+flat in uint FirstTriangle;
+
+layout (location = 0) out float FragColor;
+layout (location = 1) out vec3 Pos1;
+layout (location = 2) out uvec2 Id;
+
+// id of the first mesh of the scene
+uniform uint meshId;
+
+void main()
+{    
+    FragColor = Color.x*0.299 + Color.y*0.587 + Color.z*0.114;
+    Pos1 = Pos;
+    // gl_PrimitiveID counts through the whole scene, the triangle is relative to its mesh
+    Id = uvec2(meshId + DrawId, uint(gl_PrimitiveID) - FirstTriangle);
+}
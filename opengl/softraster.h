@@ -0,0 +1,515 @@
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+
+#include "render.h"
+#include "posejacobian.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+struct SoftRasterDesc {
+    Camera* camera = 0;
+    Model* bodyModel = 0;
+    // undeformed wing, bent by G like Render::setWingG()
+    Model* wingModel = 0;
+    // edge softness in squared pixels: a triangle covers a pixel with probability sigmoid(+-d^2 / sigma), d the distance
+    // of the pixel centre to the triangle's edge, + inside and - outside
+    float sigma = 1.0f;
+    // depth softness in normalised inverse depth (0 at zFar, 1 at zNear), smaller is closer to a z-buffer
+    float gamma = 1e-4f;
+    float backgroundGray = 0;
+    int threads = 0;            // 0: all cores
+};
+
+// the normal equations of the two residuals over tx, ty, tz, rx, ry, rz and G, see PoseJacobian::gaussNewtonStep
+struct SoftRasterResult {
+    PoseJacobianResult silhouette;      // S - reference mask / 255, S in 0..1
+    PoseJacobianResult gray;            // I - reference gray, in gray levels
+};
+
+// optional per pixel outputs of SoftRaster::render, roi sized with rows bottom-up. NULL ones are not written
+struct SoftRasterOutput {
+    float* silhouette = NULL;
+    float* gray = NULL;
+    float* silhouetteGradient = NULL;   // dS / d(tx, ty, tz, rx, ry, rz, G), 7 per pixel
+    float* grayGradient = NULL;         // dI / d(tx, ty, tz, rx, ry, rz, G), 7 per pixel
+};
+
+// differentiable CPU rendering of the body and wing for pose fitting, after the soft rasterizer of Liu et al.:
+//   S = 1 - prod_j (1 - D_j)                         the soft silhouette over the triangles j near the pixel
+//   F = sum_j D_j e_j g_j / sum_j D_j e_j            e_j = exp(zeta_j / gamma), a soft z-buffer of the mesh grays g_j
+//   I = S * F + (1 - S) * backgroundGray
+// with zeta_j the normalised inverse depth of triangle j at its centroid. the gradients are analytic, through the
+// projection of the camera's perspective and view matrices (the matrices the GL path draws with, no distortion), the
+// model transform of calculateModelMatrix and the wing offsets of WingCalibration. one pass renders both images and
+// sums J^T J and J^T r of both residuals for a Gauss-Newton step, so no finite differences are needed.
+// pixels are processed in 16 x 16 tiles spread over threads, with the state of a tile in flat per pixel arrays. compiled
+// for AVX2 the forward pass runs 8 pixels at a time with an exp approximation (2.5e-7 relative), and the backward pass
+// skips the groups of 8 pixels a triangle does not reach; otherwise everything is scalar. triangles reaching behind the
+// near plane are dropped, not clipped. gradcheck.cpp compares the gradients with central differences.
+class SoftRaster {
+public:
+    static const int PARAMETERS = 7;
+    static const int TILE = 16;
+
+    SoftRaster(SoftRasterDesc d) {
+        if (!d.camera || (!d.bodyModel && !d.wingModel)) {
+            printf("SoftRasterDesc is incomplete, program exiting...\n");
+            exit(-1);
+        }
+        desc = d;
+        setModels(d.bodyModel, d.wingModel);
+    }
+
+    void setModels(Model* body, Model* wing) {
+        desc.bodyModel = body;
+        desc.wingModel = wing;
+        wingOffsets.clear();
+        if (!wing) return;
+        std::vector<float> x, y;
+        for (auto& mesh : wing->meshes) {
+            for (auto& v : mesh.vertices) {
+                x.push_back(v.Position.x());
+                y.push_back(v.Position.y());
+            }
+        }
+        wingOffsets.resize(x.size());
+        wing->wingCalib.offsets(x.data(), y.data(), wingOffsets.data(), x.size());
+        for (float& o : wingOffsets) o /= wing->wingCalib.referenceG;
+    }
+
+    void setSigma(float sigma) { desc.sigma = sigma; }
+    void setGamma(float gamma) { desc.gamma = gamma; }
+
+    // camera sized, rows bottom-up. NULL drops a reference, its residual is then taken against 0
+    void setReferences(const unsigned char* silhouette, const unsigned char* gray) {
+        size_t n = (size_t)desc.camera->getWidth() * desc.camera->getHeight();
+        referenceSilhouette.assign(silhouette, silhouette ? silhouette + n : silhouette);
+        referenceGray.assign(gray, gray ? gray + n : gray);
+    }
+
+    // renders roi of the camera (the full frame when empty) at pose and G
+    void render(const ModelTransformDesc& pose, float G, SoftRasterResult& result, SoftRasterOutput* out = NULL,
+        RenderROI roi = RenderROI()) {
+        int W = desc.camera->getWidth(), H = desc.camera->getHeight();
+        if (roi.width <= 0 || roi.height <= 0) {
+            roi.x = roi.y = 0;
+            roi.width = W;
+            roi.height = H;
+        }
+        this->roi = roi;
+        output = out ? *out : SoftRasterOutput();
+        projectVertices(pose, G);
+        setupTriangles();
+        binTriangles();
+
+        int threads = desc.threads > 0 ? desc.threads : std::max(1, (int)std::thread::hardware_concurrency());
+        threads = std::min(threads, (int)bins.size());
+        std::vector<Sums> sums(std::max(threads, 1));
+        std::atomic<int> nextTile(0);
+        auto work = [&](int t) {
+            Tile tile;
+            for (int i = nextTile++; i < (int)bins.size(); i = nextTile++) renderTile(i, tile, sums[t]);
+        };
+        if (threads <= 1) work(0);
+        else {
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++) workers.emplace_back(work, t);
+            for (auto& w : workers) w.join();
+        }
+        for (int t = 1; t < (int)sums.size(); t++) sums[0].add(sums[t]);
+        sums[0].get(result);
+    }
+
+private:
+    struct SoftVertex {
+        float u, v, w;                  // pixels with bottom-left origin, clip w
+        float du[PARAMETERS], dv[PARAMETERS], dw[PARAMETERS];
+    };
+
+    struct SoftTriangle {
+        int a, b, c;
+        float ax, ay, bx, by, cx, cy;
+        float area;                     // twice the signed area
+        float gray;
+        float zeta;
+        float dzeta[PARAMETERS];
+    };
+
+    // accumulated in double, a full frame adds up millions of pixels
+    struct Sums {
+        double JtJ[2][PARAMETERS][PARAMETERS] = {};
+        double Jtr[2][PARAMETERS] = {};
+        double cost[2] = {};
+        long long pixels[2] = {};
+
+        void add(const Sums& o) {
+            for (int r = 0; r < 2; r++) {
+                for (int i = 0; i < PARAMETERS; i++) {
+                    for (int k = 0; k < PARAMETERS; k++) JtJ[r][i][k] += o.JtJ[r][i][k];
+                    Jtr[r][i] += o.Jtr[r][i];
+                }
+                cost[r] += o.cost[r];
+                pixels[r] += o.pixels[r];
+            }
+        }
+
+        void get(SoftRasterResult& result) {
+            PoseJacobianResult* r[2] = { &result.silhouette, &result.gray };
+            for (int k = 0; k < 2; k++) {
+                for (int i = 0; i < PARAMETERS; i++) {
+                    // only the upper triangle is summed
+                    for (int j = 0; j < PARAMETERS; j++) r[k]->JtJ[i][j] = (float)(j >= i ? JtJ[k][i][j] : JtJ[k][j][i]);
+                    r[k]->Jtr[i] = (float)Jtr[k][i];
+                }
+                r[k]->cost = (float)cost[k];
+                r[k]->pixels = (int)pixels[k];
+            }
+        }
+    };
+
+    // per pixel state of a tile, index yy * TILE + xx
+    struct Tile {
+        float px[TILE * TILE], py[TILE * TILE];
+        float notCovered[TILE * TILE];  // prod (1 - D_j)
+        float weight[TILE * TILE];      // sum D_j e_j, e_j relative to zetaMax
+        float weighted[TILE * TILE];    // sum D_j e_j g_j
+        float zetaMax[TILE * TILE];
+        float S[TILE * TILE], F[TILE * TILE];
+        float JS[PARAMETERS][TILE * TILE], JI[PARAMETERS][TILE * TILE];
+    };
+
+    SoftRasterDesc desc;
+    RenderROI roi;
+    SoftRasterOutput output;
+    std::vector<float> wingOffsets;             // wing vertices in mesh order, offset / referenceG
+    std::vector<unsigned char> referenceSilhouette;
+    std::vector<unsigned char> referenceGray;
+    std::vector<SoftVertex> vertices;
+    std::vector<SoftTriangle> triangles;
+    std::vector<std::vector<int>> bins;         // triangles reaching each tile
+    int tilesX = 0;
+    float cutoff = 0;                           // D is taken as 0 beyond d^2 / sigma > cutoff outside the triangle
+
+    static Eigen::Matrix3f skew(const V3f& a) {
+        Eigen::Matrix3f m;
+        m << 0, -a.z(), a.y(),
+            a.z(), 0, -a.x(),
+            -a.y(), a.x(), 0;
+        return m;
+    }
+
+    void projectVertices(const ModelTransformDesc& pose, float G) {
+        int W = desc.camera->getWidth(), H = desc.camera->getHeight();
+        M4f M = desc.camera->getPerspectiveMatrix() * desc.camera->getViewMatrix();
+        Eigen::Matrix3f Rx, Ry, Rz;
+        Rx = Eigen::AngleAxisf(pose.rx, V3f::UnitX());
+        Ry = Eigen::AngleAxisf(pose.ry, V3f::UnitY());
+        Rz = Eigen::AngleAxisf(pose.rz, V3f::UnitZ());
+        Eigen::Matrix3f R = Rx * Ry * Rz;
+        // derivatives of scale * R by rx, ry and rz
+        Eigen::Matrix3f dR[3] = {
+            pose.scale * skew(V3f::UnitX()) * R,
+            pose.scale * Rx * skew(V3f::UnitY()) * Ry * Rz,
+            pose.scale * Rx * Ry * skew(V3f::UnitZ()) * Rz };
+        V3f t(pose.tx, pose.ty, pose.tz);
+        V3f dG = pose.scale * R * V3f::UnitZ();
+        Eigen::RowVector3f m0 = M.block<1, 3>(0, 0), m1 = M.block<1, 3>(1, 0), m3 = M.block<1, 3>(3, 0);
+
+        vertices.clear();
+        Model* models[2] = { desc.bodyModel, desc.wingModel };
+        for (int m = 0; m < 2; m++) {
+            if (!models[m]) continue;
+            size_t wingVertex = 0;
+            for (auto& mesh : models[m]->meshes) {
+                for (auto& vertex : mesh.vertices) {
+                    float offset = m == 1 ? wingOffsets[wingVertex++] : 0;
+                    V3f p = vertex.Position;
+                    p.z() += offset * G;
+                    V3f X = pose.scale * R * p + t;
+                    Eigen::Vector4f c = M * Eigen::Vector4f(X.x(), X.y(), X.z(), 1);
+                    SoftVertex s;
+                    s.w = c.w();
+                    float iw = c.w() != 0 ? 1 / c.w() : 0;
+                    s.u = (c.x() * iw + 1) * 0.5f * W;
+                    s.v = (c.y() * iw + 1) * 0.5f * H;
+                    // d(u, v) / dX of the perspective division
+                    Eigen::RowVector3f du = 0.5f * W * (m0 * c.w() - c.x() * m3) * iw * iw;
+                    Eigen::RowVector3f dv = 0.5f * H * (m1 * c.w() - c.y() * m3) * iw * iw;
+                    for (int k = 0; k < PARAMETERS; k++) {
+                        V3f dX = k < 3 ? V3f(V3f::Unit(k)) : k < 6 ? V3f(dR[k - 3] * p) : V3f(dG * offset);
+                        s.du[k] = du * dX;
+                        s.dv[k] = dv * dX;
+                        s.dw[k] = m3 * dX;
+                    }
+                    vertices.push_back(s);
+                }
+            }
+        }
+    }
+
+    void setupTriangles() {
+        CameraPara C = desc.camera->getCameraPara();
+        float zetaScale = 1 / (1 / C.zNear - 1 / C.zFar);
+        triangles.clear();
+        Model* models[2] = { desc.bodyModel, desc.wingModel };
+        int base = 0;
+        for (int m = 0; m < 2; m++) {
+            if (!models[m]) continue;
+            for (auto& mesh : models[m]->meshes) {
+                float gray = (mesh.colors.r * 0.299f + mesh.colors.g * 0.587f + mesh.colors.b * 0.114f) * 255;
+                for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+                    SoftTriangle tri;
+                    tri.a = base + mesh.indices[i];
+                    tri.b = base + mesh.indices[i + 1];
+                    tri.c = base + mesh.indices[i + 2];
+                    const SoftVertex& A = vertices[tri.a], & B = vertices[tri.b], & Cv = vertices[tri.c];
+                    if (A.w < C.zNear || B.w < C.zNear || Cv.w < C.zNear) continue;
+                    tri.ax = A.u; tri.ay = A.v;
+                    tri.bx = B.u; tri.by = B.v;
+                    tri.cx = Cv.u; tri.cy = Cv.v;
+                    tri.area = (tri.bx - tri.ax) * (tri.cy - tri.ay) - (tri.by - tri.ay) * (tri.cx - tri.ax);
+                    if (std::fabs(tri.area) < 1e-8f) continue;
+                    tri.gray = gray;
+                    float z = (A.w + B.w + Cv.w) / 3;
+                    tri.zeta = (1 / z - 1 / C.zFar) * zetaScale;
+                    float dzeta = -zetaScale / (z * z) / 3;
+                    for (int k = 0; k < PARAMETERS; k++)
+                        tri.dzeta[k] = dzeta * (A.dw[k] + B.dw[k] + Cv.dw[k]);
+                    triangles.push_back(tri);
+                }
+                base += (int)mesh.vertices.size();
+            }
+        }
+    }
+
+    void binTriangles() {
+        // coverage below 1e-4 outside the triangle is dropped, that is d^2 / sigma > ln(1e4)
+        cutoff = std::log(1e4f);
+        float radius = std::sqrt(desc.sigma * cutoff);
+        tilesX = (roi.width + TILE - 1) / TILE;
+        int tilesY = (roi.height + TILE - 1) / TILE;
+        bins.assign((size_t)tilesX * tilesY, std::vector<int>());
+        for (int i = 0; i < (int)triangles.size(); i++) {
+            const SoftTriangle& t = triangles[i];
+            float x0 = std::min(t.ax, std::min(t.bx, t.cx)) - radius - roi.x, x1 = std::max(t.ax, std::max(t.bx, t.cx)) + radius - roi.x;
+            float y0 = std::min(t.ay, std::min(t.by, t.cy)) - radius - roi.y, y1 = std::max(t.ay, std::max(t.by, t.cy)) + radius - roi.y;
+            if (x1 < 0 || y1 < 0 || x0 >= roi.width || y0 >= roi.height) continue;
+            int tx0 = std::max(0, (int)std::floor(x0) / TILE), tx1 = std::min(tilesX - 1, (int)std::floor(x1) / TILE);
+            int ty0 = std::max(0, (int)std::floor(y0) / TILE), ty1 = std::min(tilesY - 1, (int)std::floor(y1) / TILE);
+            for (int ty = ty0; ty <= ty1; ty++)
+                for (int tx = tx0; tx <= tx1; tx++) bins[(size_t)ty * tilesX + tx].push_back(i);
+        }
+    }
+
+    // coverage D of pixel centre (px, py), its derivative by d^2 and d(d^2) / d(ua, va, ub, vb, uc, vc) of the nearest edge
+    inline void coverage(const SoftTriangle& t, float px, float py, float& D, float& dD, float* g) const {
+        float e0 = (t.bx - t.ax) * (py - t.ay) - (t.by - t.ay) * (px - t.ax);
+        float e1 = (t.cx - t.bx) * (py - t.by) - (t.cy - t.by) * (px - t.bx);
+        float e2 = (t.ax - t.cx) * (py - t.cy) - (t.ay - t.cy) * (px - t.cx);
+        bool isInside = t.area > 0 ? (e0 >= 0 && e1 >= 0 && e2 >= 0) : (e0 <= 0 && e1 <= 0 && e2 <= 0);
+        float d2[3], s[3], dx[3], dy[3];
+        const float x[4] = { t.ax, t.bx, t.cx, t.ax }, y[4] = { t.ay, t.by, t.cy, t.ay };
+        for (int e = 0; e < 3; e++) {
+            float ex = x[e + 1] - x[e], ey = y[e + 1] - y[e];
+            float len2 = ex * ex + ey * ey;
+            float p = len2 > 0 ? ((px - x[e]) * ex + (py - y[e]) * ey) / len2 : 0;
+            s[e] = std::min(1.0f, std::max(0.0f, p));
+            dx[e] = px - (x[e] + s[e] * ex);
+            dy[e] = py - (y[e] + s[e] * ey);
+            d2[e] = dx[e] * dx[e] + dy[e] * dy[e];
+        }
+        int e = d2[1] < d2[0] ? (d2[2] < d2[1] ? 2 : 1) : (d2[2] < d2[0] ? 2 : 0);
+        float sign = isInside ? 1.0f : -1.0f;
+        float arg = sign * d2[e] / desc.sigma;
+        D = arg < -cutoff ? 0 : 1 / (1 + std::exp(-arg));
+        dD = D * (1 - D) * sign / desc.sigma;
+        // the nearest point moves with the edge's ends, weighted by where it lies on the edge
+        for (int k = 0; k < 6; k++) g[k] = 0;
+        int from = e, to = (e + 1) % 3;
+        g[from * 2] = -2 * (1 - s[e]) * dx[e];
+        g[from * 2 + 1] = -2 * (1 - s[e]) * dy[e];
+        g[to * 2] = -2 * s[e] * dx[e];
+        g[to * 2 + 1] = -2 * s[e] * dy[e];
+    }
+
+#ifdef __AVX2__
+    // a * b + c, fused when FMA is there, see WingCalibration::madd
+    static __m256 madd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__) || defined(_MSC_VER)
+        return _mm256_fmadd_ps(a, b, c);
+#else
+        return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+    }
+
+    // e^x to 2.5e-7 relative, 0 below -87 and e^88 above 88: x = n ln2 + r with |r| <= ln2 / 2, e^r by its Taylor
+    // polynomial and 2^n built in the exponent bits
+    static __m256 exp8(__m256 x) {
+        __m256 t = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(88.0f));
+        __m256 n = _mm256_round_ps(_mm256_mul_ps(t, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 r = _mm256_sub_ps(_mm256_sub_ps(t, _mm256_mul_ps(n, _mm256_set1_ps(0.693145752f))), _mm256_mul_ps(n, _mm256_set1_ps(1.42860677e-6f)));
+        const float coef[7] = { 1 / 720.0f, 1 / 120.0f, 1 / 24.0f, 1 / 6.0f, 0.5f, 1.0f, 1.0f };
+        __m256 p = _mm256_set1_ps(coef[0]);
+        for (int k = 1; k < 7; k++) p = madd(p, r, _mm256_set1_ps(coef[k]));
+        __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        return _mm256_andnot_ps(_mm256_cmp_ps(x, _mm256_set1_ps(-87.0f), _CMP_LT_OQ), _mm256_mul_ps(p, _mm256_castsi256_ps(e)));
+    }
+
+    // D of coverage() for the 8 pixel centres at px, py
+    __m256 coverage8(const SoftTriangle& t, const float* px, const float* py) const {
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+        __m256 X = _mm256_loadu_ps(px), Y = _mm256_loadu_ps(py);
+        __m256 d2 = _mm256_set1_ps(FLT_MAX), edgeMin = _mm256_set1_ps(FLT_MAX), edgeMax = _mm256_set1_ps(-FLT_MAX);
+        const float x[4] = { t.ax, t.bx, t.cx, t.ax }, y[4] = { t.ay, t.by, t.cy, t.ay };
+        for (int e = 0; e < 3; e++) {
+            float ex = x[e + 1] - x[e], ey = y[e + 1] - y[e];
+            float len2 = ex * ex + ey * ey;
+            __m256 vx = _mm256_set1_ps(ex), vy = _mm256_set1_ps(ey);
+            __m256 rx = _mm256_sub_ps(X, _mm256_set1_ps(x[e])), ry = _mm256_sub_ps(Y, _mm256_set1_ps(y[e]));
+            __m256 p = len2 > 0 ? _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(rx, vx), _mm256_mul_ps(ry, vy)), _mm256_set1_ps(len2)) : zero;
+            __m256 s = _mm256_min_ps(one, _mm256_max_ps(zero, p));
+            __m256 dx = _mm256_sub_ps(X, _mm256_add_ps(_mm256_set1_ps(x[e]), _mm256_mul_ps(s, vx)));
+            __m256 dy = _mm256_sub_ps(Y, _mm256_add_ps(_mm256_set1_ps(y[e]), _mm256_mul_ps(s, vy)));
+            d2 = _mm256_min_ps(d2, _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+            __m256 side = _mm256_sub_ps(_mm256_mul_ps(vx, ry), _mm256_mul_ps(vy, rx));
+            edgeMin = _mm256_min_ps(edgeMin, side);
+            edgeMax = _mm256_max_ps(edgeMax, side);
+        }
+        __m256 isInside = t.area > 0 ? _mm256_cmp_ps(edgeMin, zero, _CMP_GE_OQ) : _mm256_cmp_ps(edgeMax, zero, _CMP_LE_OQ);
+        __m256 sign = _mm256_blendv_ps(_mm256_set1_ps(-1.0f), one, isInside);
+        __m256 arg = _mm256_div_ps(_mm256_mul_ps(sign, d2), _mm256_set1_ps(desc.sigma));
+        __m256 D = _mm256_div_ps(one, _mm256_add_ps(one, exp8(_mm256_sub_ps(zero, arg))));
+        return _mm256_and_ps(D, _mm256_cmp_ps(arg, _mm256_set1_ps(-cutoff), _CMP_GE_OQ));
+    }
+
+    // the forward step of the scalar loop in renderTile for pixels i..i+7
+    void forward8(const SoftTriangle& t, Tile& tile, int i) const {
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), gamma = _mm256_set1_ps(desc.gamma);
+        const __m256 zeta = _mm256_set1_ps(t.zeta);
+        __m256 D = coverage8(t, tile.px + i, tile.py + i);
+        __m256 isCovering = _mm256_cmp_ps(D, zero, _CMP_GT_OQ);
+        __m256 oldMax = _mm256_loadu_ps(tile.zetaMax + i);
+        __m256 zetaMax = _mm256_blendv_ps(oldMax, _mm256_max_ps(oldMax, zeta), isCovering);
+        __m256 rescale = _mm256_and_ps(exp8(_mm256_div_ps(_mm256_sub_ps(oldMax, zetaMax), gamma)),
+            _mm256_cmp_ps(oldMax, _mm256_set1_ps(-FLT_MAX), _CMP_GT_OQ));
+        __m256 a = _mm256_and_ps(_mm256_mul_ps(D, exp8(_mm256_div_ps(_mm256_sub_ps(zeta, zetaMax), gamma))), isCovering);
+        _mm256_storeu_ps(tile.notCovered + i, _mm256_mul_ps(_mm256_loadu_ps(tile.notCovered + i), _mm256_sub_ps(one, D)));
+        _mm256_storeu_ps(tile.weight + i, madd(_mm256_loadu_ps(tile.weight + i), rescale, a));
+        _mm256_storeu_ps(tile.weighted + i, madd(_mm256_loadu_ps(tile.weighted + i), rescale, _mm256_mul_ps(a, _mm256_set1_ps(t.gray))));
+        _mm256_storeu_ps(tile.zetaMax + i, zetaMax);
+    }
+#endif
+
+    void renderTile(int index, Tile& tile, Sums& sums) {
+        const std::vector<int>& bin = bins[index];
+        int x0 = (index % tilesX) * TILE, y0 = (index / tilesX) * TILE;
+        int w = std::min(TILE, roi.width - x0), h = std::min(TILE, roi.height - y0);
+        const int N = TILE * TILE;
+        const float gamma = desc.gamma, bg = desc.backgroundGray;
+        for (int i = 0; i < N; i++) {
+            tile.px[i] = roi.x + x0 + i % TILE + 0.5f;
+            tile.py[i] = roi.y + y0 + i / TILE + 0.5f;
+            tile.notCovered[i] = 1;
+            tile.weight[i] = 0;
+            tile.weighted[i] = 0;
+            tile.zetaMax[i] = -FLT_MAX;
+        }
+        for (int k = 0; k < PARAMETERS; k++) {
+            std::fill(tile.JS[k], tile.JS[k] + N, 0.0f);
+            std::fill(tile.JI[k], tile.JI[k] + N, 0.0f);
+        }
+
+        // forward: the soft z-buffer keeps its weights relative to the nearest covering triangle so far
+        float D, dD, g[6];
+        for (int j : bin) {
+            const SoftTriangle& t = triangles[j];
+            int i = 0;
+#ifdef __AVX2__
+            for (; i < N; i += 8) forward8(t, tile, i);
+#endif
+            for (; i < N; i++) {
+                coverage(t, tile.px[i], tile.py[i], D, dD, g);
+                tile.notCovered[i] *= 1 - D;
+                float zetaMax = D > 0 ? std::max(tile.zetaMax[i], t.zeta) : tile.zetaMax[i];
+                float rescale = tile.zetaMax[i] > -FLT_MAX ? std::exp((tile.zetaMax[i] - zetaMax) / gamma) : 0;
+                float a = D > 0 ? D * std::exp((t.zeta - zetaMax) / gamma) : 0;
+                tile.weight[i] = tile.weight[i] * rescale + a;
+                tile.weighted[i] = tile.weighted[i] * rescale + a * t.gray;
+                tile.zetaMax[i] = zetaMax;
+            }
+        }
+        for (int i = 0; i < N; i++) {
+            tile.S[i] = 1 - tile.notCovered[i];
+            tile.F[i] = tile.weight[i] > 0 ? tile.weighted[i] / tile.weight[i] : 0;
+        }
+
+        // backward: dS / dD_j = prod_{k != j} (1 - D_k), dI / dD_j and dI / dzeta_j through the composite and the blend
+        for (int j : bin) {
+            const SoftTriangle& t = triangles[j];
+            const SoftVertex* v[3] = { &vertices[t.a], &vertices[t.b], &vertices[t.c] };
+            for (int i = 0; i < N; i++) {
+#ifdef __AVX2__
+                if (i % 8 == 0 && !_mm256_movemask_ps(_mm256_cmp_ps(coverage8(t, tile.px + i, tile.py + i), _mm256_setzero_ps(), _CMP_GT_OQ))) {
+                    i += 7;
+                    continue;
+                }
+#endif
+                coverage(t, tile.px[i], tile.py[i], D, dD, g);
+                if (D <= 0) continue;
+                float S = tile.S[i], F = tile.F[i];
+                float invWeight = tile.weight[i] > 0 ? 1 / tile.weight[i] : 0;
+                float e = std::exp((t.zeta - tile.zetaMax[i]) / gamma);
+                float dSdD = tile.notCovered[i] / std::max(1 - D, 1e-7f);
+                float cS = dSdD * dD;
+                float cI = ((F - bg) * dSdD + S * e * (t.gray - F) * invWeight) * dD;
+                float cZeta = S * D * e * (t.gray - F) * invWeight / gamma;
+                for (int k = 0; k < PARAMETERS; k++) {
+                    float dd2 = g[0] * v[0]->du[k] + g[1] * v[0]->dv[k] + g[2] * v[1]->du[k] + g[3] * v[1]->dv[k]
+                        + g[4] * v[2]->du[k] + g[5] * v[2]->dv[k];
+                    tile.JS[k][i] += cS * dd2;
+                    tile.JI[k][i] += cI * dd2 + cZeta * t.dzeta[k];
+                }
+            }
+        }
+
+        int W = desc.camera->getWidth();
+        for (int yy = 0; yy < h; yy++) {
+            for (int xx = 0; xx < w; xx++) {
+                int i = yy * TILE + xx;
+                float S = tile.S[i];
+                float I = S * tile.F[i] + (1 - S) * bg;
+                size_t frame = (size_t)(roi.y + y0 + yy) * W + roi.x + x0 + xx;
+                size_t pixel = (size_t)(y0 + yy) * roi.width + x0 + xx;
+                float r[2] = {
+                    S - (referenceSilhouette.empty() ? 0 : referenceSilhouette[frame] / 255.0f),
+                    I - (referenceGray.empty() ? 0 : (float)referenceGray[frame]) };
+                for (int o = 0; o < 2; o++) {
+                    float (*J)[N] = o == 0 ? tile.JS : tile.JI;
+                    bool isInformative = false;
+                    for (int a = 0; a < PARAMETERS; a++) {
+                        isInformative = isInformative || J[a][i] != 0;
+                        for (int b = a; b < PARAMETERS; b++) sums.JtJ[o][a][b] += (double)J[a][i] * J[b][i];
+                        sums.Jtr[o][a] += (double)J[a][i] * r[o];
+                    }
+                    sums.cost[o] += (double)r[o] * r[o];
+                    if (isInformative) sums.pixels[o]++;
+                }
+                if (output.silhouette) output.silhouette[pixel] = S;
+                if (output.gray) output.gray[pixel] = I;
+                for (int k = 0; k < PARAMETERS; k++) {
+                    if (output.silhouetteGradient) output.silhouetteGradient[pixel * PARAMETERS + k] = tile.JS[k][i];
+                    if (output.grayGradient) output.grayGradient[pixel * PARAMETERS + k] = tile.JI[k][i];
+                }
+            }
+        }
+    }
+};
+
+#endif
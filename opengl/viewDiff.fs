@@ -0,0 +1,27 @@
+#version 330 core
+#define MAX_VIEWS 16
+
+uniform sampler2DArray colorTexture;
+uniform sampler2DArray referenceTexture;
+uniform ivec2 viewSize[MAX_VIEWS];
+uniform bool isGray;
+
+layout (location = 0) out float RowSum;
+
+// one fragment per row and view: the squared gray differences along the row, in gray levels
+void main()
+{
+    int row = int(gl_FragCoord.x);
+    int view = int(gl_FragCoord.y);
+    ivec2 size = viewSize[view];
+    float sum = 0.0;
+    if (row < size.y) {
+        for (int x = 0; x < size.x; x++) {
+            vec3 c = texelFetch(colorTexture, ivec3(x, row, view), 0).rgb;
+            float gray = isGray ? c.r : dot(c, vec3(0.299, 0.587, 0.114));
+            float d = (gray - texelFetch(referenceTexture, ivec3(x, row, view), 0).r) * 255.0;
+            sum += d * d;
+        }
+    }
+    RowSum = sum;
+}
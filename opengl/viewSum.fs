@@ -0,0 +1,18 @@
+#version 330 core
+#define MAX_VIEWS 16
+
+// viewDiff.fs output, a row per view
+uniform sampler2D rowSums;
+uniform ivec2 viewSize[MAX_VIEWS];
+
+layout (location = 0) out float Score;
+
+// one fragment per view: mean squared gray difference over the view
+void main()
+{
+    int view = int(gl_FragCoord.y);
+    ivec2 size = viewSize[view];
+    float sum = 0.0;
+    for (int row = 0; row < size.y; row++) sum += texelFetch(rowSums, ivec2(row, view), 0).r;
+    Score = sum / float(size.x * size.y);
+}
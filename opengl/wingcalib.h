@@ -0,0 +1,198 @@
+#ifndef WINGCALIB_H
+#define WINGCALIB_H
+
+#include <Eigen\Dense>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// the wing bending calibration, the one place its numbers live. Model evaluates it on the CPU and the wing shaders get it
+// as generated GLSL, so both always use the same coefficients.
+// the z offset of a wing vertex blends two polynomials in x (front and back edge, mm) by where y lies between the edge lines.
+struct WingCalibration {
+    // number of coefficients used of front and back, highest power first
+    int degree = 7;
+    float front[7] = { -6.279e-23f, 1.302e-28f, 4.245e-14f, 2.873e-19f, 2.453e-06f, -5.177e-11f, -54.852f };
+    float back[7] = { -5.503e-23f, -8.618e-21f, 3.599e-14f, 5.498e-12f, 3.816e-06f, -3.007e-04f, -66.54f };
+    // y of the front edge over |x| and of the back edge over x, inch
+    float lineFront[2] = { -0.5192f, 243.9f };
+    float lineBack[7] = { -2.907e-16f, 6.746e-16f, 1.491e-10f, -4.031e-10f, -0.000323f, 3.6e-05f, -31.02f };
+    // load the offsets are measured at, the offset scales linearly with G / referenceG
+    float referenceG = 2.5f;
+
+    static double polynomial(const float* coef, int len, double x) {
+        double output = 0;
+        for (int a = 0; a < len; a++) {
+            output = output * x;
+            output = output + coef[a];
+        }
+        return output;
+    }
+
+    // z offset in inch of a wing vertex at referenceG. evaluated in double: the highest coefficients are around 1e-23 against
+    // x_mm in the thousands, where float Horner loses most of its digits
+    float offset(const Eigen::Vector3f& p) const {
+        return (float)offset((double)p.x(), (double)p.y());
+    }
+
+    double offset(double x, double y) const {
+        double x_mm = x * 25.4;
+        double z_front = 0, z_back = 0, y_back = 0;
+        for (int a = 0; a < degree; a++) {
+            z_front = z_front * x_mm + front[a];
+            z_back = z_back * x_mm + back[a];
+        }
+        for (int a = 0; a < 7; a++) y_back = y_back * x + lineBack[a];
+        double y_front = (double)lineFront[0] * (x > 0 ? x : -x) + lineFront[1];
+        double ratio = (y_front - y) / (y_front - y_back);
+        return (z_front * ratio + z_back * (1 - ratio)) / 25.4;
+    }
+
+    // offsets of n vertices given as separate x and y arrays, the same double precision evaluation as offset().
+    // 4 vertices per step with AVX2 when compiled for it, and split over `threads` threads (0: all cores) for large inputs
+    void offsets(const float* x, const float* y, float* out, size_t n, int threads = 0) const {
+        const size_t minPerThread = 16384;
+        if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+        threads = (int)std::min<size_t>((size_t)threads, std::max<size_t>(1, n / minPerThread));
+        if (threads <= 1) {
+            offsetsRange(x, y, out, 0, n);
+            return;
+        }
+        std::vector<std::thread> workers;
+        size_t chunk = (n + threads - 1) / threads;
+        for (int t = 0; t < threads; t++) {
+            size_t begin = t * chunk, end = std::min(n, begin + chunk);
+            if (begin < end) workers.emplace_back([=]() { offsetsRange(x, y, out, begin, end); });
+        }
+        for (auto& w : workers) w.join();
+    }
+
+    // lookup table of the 4 polynomials (front, back, y_front, y_back) at n evenly spaced x from xMin to xMax, RGBA per sample.
+    // the x only parts are all that the offset needs besides y, so a 1D texture replaces them in the shader.
+    void buildLut(float xMin, float xMax, int n, std::vector<float>& lut) const {
+        lut.resize((size_t)n * 4);
+        for (int i = 0; i < n; i++) {
+            double x = n > 1 ? xMin + (double)(xMax - xMin) * i / (n - 1) : xMin;
+            lut[i * 4] = (float)polynomial(front, degree, x * 25.4);
+            lut[i * 4 + 1] = (float)polynomial(back, degree, x * 25.4);
+            lut[i * 4 + 2] = (float)polynomial(lineFront, 2, x > 0 ? x : -x);
+            lut[i * 4 + 3] = (float)polynomial(lineBack, 7, x);
+        }
+    }
+
+    // texture coordinate of x in a buildLut() table is x * scale + bias, hitting the texel centres at the sample points
+    static Eigen::Vector2f lutRange(float xMin, float xMax, int n) {
+        float scale = xMax > xMin ? (n - 1) / ((xMax - xMin) * n) : 0;
+        return Eigen::Vector2f(scale, 0.5f / n - xMin * scale);
+    }
+
+    // the shader evaluates in float what offset() evaluates in double, so CPU (Model::calibrateWing, offsets()) and GPU
+    // wing positions agree to a tolerance, not bit for bit. with the default calibration, Horner in float against double
+    // differs by at most 3e-5 inch over |x| <= 600 inch, where the offsets reach 80 inch: a few float ulps of the offset.
+    // GPU division is allowed 2.5 ulps, which keeps the total well under 1e-4 inch.
+    // source with `float wingOffset(vec3 p)` defined right after its #version line. the constant variant has every
+    // coefficient as a constant and the degree as WING_DEGREE, so the loops have constant bounds and unroll.
+    // the lut variant reads the polynomials from `uniform sampler1D wingLut` at `uniform vec2 wingLutRange`.
+    std::string shaderSource(const std::string& source, bool isLut) const {
+        std::string code;
+        if (isLut) {
+            code =
+                "#define WING_LUT\n"
+                "uniform sampler1D wingLut;\n"
+                "uniform vec2 wingLutRange;\n"
+                "float wingOffset(vec3 p) {\n"
+                "    vec4 v = textureLod(wingLut, p.x * wingLutRange.x + wingLutRange.y, 0.0);\n"
+                "    float ratio = (v.z - p.y) / (v.z - v.w);\n"
+                "    return (v.x * ratio + v.y * (1.0 - ratio)) * (1.0 / 25.4);\n"
+                "}\n";
+        }
+        else {
+            code = "#define WING_DEGREE " + std::to_string(degree) + "\n"
+                + "const float wingFront[WING_DEGREE] = " + glslArray(front, degree) + ";\n"
+                + "const float wingBack[WING_DEGREE] = " + glslArray(back, degree) + ";\n"
+                + "const float wingLineBack[7] = " + glslArray(lineBack, 7) + ";\n"
+                "float wingOffset(vec3 p) {\n"
+                "    float x_mm = p.x * 25.4;\n"
+                "    float z_front = 0.0, z_back = 0.0, y_back = 0.0;\n"
+                "    for (int a = 0; a < WING_DEGREE; a++) {\n"
+                "        z_front = z_front * x_mm + wingFront[a];\n"
+                "        z_back = z_back * x_mm + wingBack[a];\n"
+                "    }\n"
+                "    for (int a = 0; a < 7; a++) y_back = y_back * p.x + wingLineBack[a];\n"
+                "    float y_front = " + glslFloat(lineFront[0]) + " * abs(p.x) + " + glslFloat(lineFront[1]) + ";\n"
+                "    float ratio = (y_front - p.y) / (y_front - y_back);\n"
+                "    return (z_front * ratio + z_back * (1.0 - ratio)) * (1.0 / 25.4);\n"
+                "}\n";
+        }
+        code += "const float WING_REFERENCE_G = " + glslFloat(referenceG) + ";\n";
+        size_t line = source.find('\n');
+        if (line == std::string::npos) return source + "\n" + code;
+        return source.substr(0, line + 1) + code + source.substr(line + 1);
+    }
+
+    bool operator==(const WingCalibration& o) const {
+        return degree == o.degree && referenceG == o.referenceG && !memcmp(front, o.front, sizeof(front)) && !memcmp(back, o.back, sizeof(back))
+            && !memcmp(lineFront, o.lineFront, sizeof(lineFront)) && !memcmp(lineBack, o.lineBack, sizeof(lineBack));
+    }
+    bool operator!=(const WingCalibration& o) const { return !(*this == o); }
+
+private:
+    void offsetsRange(const float* x, const float* y, float* out, size_t begin, size_t end) const {
+        size_t i = begin;
+#ifdef __AVX2__
+        const __m256d mm = _mm256_set1_pd(25.4);
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d signMask = _mm256_set1_pd(-0.0);
+        for (; i + 4 <= end; i += 4) {
+            __m256d vx = _mm256_cvtps_pd(_mm_loadu_ps(x + i));
+            __m256d vy = _mm256_cvtps_pd(_mm_loadu_ps(y + i));
+            __m256d x_mm = _mm256_mul_pd(vx, mm);
+            __m256d z_front = _mm256_setzero_pd(), z_back = _mm256_setzero_pd(), y_back = _mm256_setzero_pd();
+            for (int a = 0; a < degree; a++) {
+                z_front = madd(z_front, x_mm, _mm256_set1_pd(front[a]));
+                z_back = madd(z_back, x_mm, _mm256_set1_pd(back[a]));
+            }
+            for (int a = 0; a < 7; a++) y_back = madd(y_back, vx, _mm256_set1_pd(lineBack[a]));
+            __m256d y_front = madd(_mm256_andnot_pd(signMask, vx), _mm256_set1_pd(lineFront[0]), _mm256_set1_pd(lineFront[1]));
+            __m256d ratio = _mm256_div_pd(_mm256_sub_pd(y_front, vy), _mm256_sub_pd(y_front, y_back));
+            __m256d z = madd(z_front, ratio, _mm256_mul_pd(z_back, _mm256_sub_pd(one, ratio)));
+            _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_div_pd(z, mm)));
+        }
+#endif
+        for (; i < end; i++) out[i] = (float)offset((double)x[i], (double)y[i]);
+    }
+
+#ifdef __AVX2__
+    // a * b + c, fused where the compiler may use FMA (every AVX2 CPU has it, MSVC does not define __FMA__ for /arch:AVX2)
+    static __m256d madd(__m256d a, __m256d b, __m256d c) {
+#if defined(__FMA__) || defined(_MSC_VER)
+        return _mm256_fmadd_pd(a, b, c);
+#else
+        return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+    }
+#endif
+
+    // enough digits to give back the exact float, always with a '.' or exponent so GLSL reads it as float
+    static std::string glslFloat(float v) {
+        char s[32];
+        snprintf(s, sizeof(s), "%.9g", v);
+        std::string str = s;
+        if (str.find_first_of(".eE") == std::string::npos) str += ".0";
+        return str;
+    }
+
+    static std::string glslArray(const float* v, int n) {
+        std::string s = "float[" + std::to_string(n) + "](";
+        for (int i = 0; i < n; i++) s += (i ? ", " : "") + glslFloat(v[i]);
+        return s + ")";
+    }
+};
+
+#endif